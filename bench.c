@@ -0,0 +1,364 @@
+/**
+ * bench.c
+ *
+ * Measures the latency of the allocator's core operations. For every combination of table size,
+ * placement policy and occupancy level a new system is filled with random files up to the
+ * occupancy, then churned: each step deletes a random file and adds a new one, so occupancy
+ * stays level while the free space fragments the way it does in use. Every call in the churn is
+ * timed on its own and recorded in a histogram, and one result row per operation is printed.
+ *
+ * Usage:
+ *     bench.out [options]
+ *
+ * Options:
+ *     -s <sizes>         Table sizes in blocks, comma separated, K and M suffixes allowed
+ *                        (default 1K,10K,100K,1M,10M).
+ *     -p <policies>      Placement policies, comma separated (default all of them).
+ *     -o <occupancies>   Occupancy levels in percent, comma separated (default 50,75,90).
+ *     -b <backend>       Block table backend, blocks (default) or extents.
+ *     -n <operations>    Delete and add pairs timed per combination (default 100000).
+ *     -r <seed>          Seed of the random number generator (default 1).
+ *     -f <format>        Output format, csv (default) or json.
+ *
+ * Latencies include the cost of reading the clock, which is a few tens of nanoseconds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "memorySystem.h"
+#include "histogram.h"
+#include "workload.h"
+
+#define BENCH_BLOCK_SIZE 4096
+#define BENCH_MAX_FILE_BLOCKS 64
+#define BENCH_MAX_LIST 32
+
+/* The operations timed by the benchmark. */
+#define BENCH_CHECK 0
+#define BENCH_PLACE 1
+#define BENCH_UPDATE 2
+#define BENCH_ADD_ENTRY 3
+#define BENCH_FIND 4
+#define BENCH_RELEASE 5
+#define BENCH_DELETE_ENTRY 6
+#define BENCH_OPERATIONS 7
+
+static const char* operationNames[BENCH_OPERATIONS] = {
+    "checkForSpace", "choosePlacement", "updateTable", "addToDirectory",
+    "findEntryInDirectory", "releaseTable", "deleteFromDirectory"
+};
+
+/**
+ * Settings given on the command line.
+ */
+typedef struct settings {
+    long sizes[BENCH_MAX_LIST];
+    int sizeCount;
+    long policies[BENCH_MAX_LIST];
+    int policyCount;
+    long occupancies[BENCH_MAX_LIST];
+    int occupancyCount;
+    long operations;
+    uint64_t seed;
+    int backend;
+    int json;
+} Settings;
+
+int parseList(const char* text, long* values, int* count, int isPolicy);
+void runBenchmark(Settings* settings, long blocks, int policy, int occupancy, Histogram* histograms);
+void printResults(Settings* settings, long blocks, int policy, int occupancy, Histogram* histograms);
+void printUsage(const char* program);
+int main(int argc, char** argv) {
+    int option, i, j, k;
+    char* endPointer;
+    Settings settings;
+    Histogram histograms[BENCH_OPERATIONS];
+
+    parseList("1K,10K,100K,1M,10M", settings.sizes, &settings.sizeCount, 0);
+    parseList("50,75,90", settings.occupancies, &settings.occupancyCount, 0);
+    settings.policyCount = POLICY_COUNT;
+    for (i = 0; i < POLICY_COUNT; i++) {
+        settings.policies[i] = i;
+    }
+    settings.operations = 100000;
+    settings.seed = 1;
+    settings.backend = TABLE_BLOCKS;
+    settings.json = 0;
+
+    while ((option = getopt(argc, argv, "s:p:o:b:n:r:f:")) != -1) {
+        int result = 0;
+        switch (option) {
+            case 's':
+                result = parseList(optarg, settings.sizes, &settings.sizeCount, 0);
+                break;
+            case 'p':
+                result = parseList(optarg, settings.policies, &settings.policyCount, 1);
+                break;
+            case 'o':
+                result = parseList(optarg, settings.occupancies, &settings.occupancyCount, 0);
+                for (i = 0; result == 0 && i < settings.occupancyCount; i++) {
+                    result = settings.occupancies[i] <= 100 ? 0 : -1;
+                }
+                break;
+            case 'b':
+                settings.backend = parseBackend(optarg);
+                result = settings.backend < 0 ? -1 : 0;
+                break;
+            case 'n':
+                settings.operations = strtol(optarg, &endPointer, 10);
+                result = *endPointer != '\0' || settings.operations <= 0 ? -1 : 0;
+                break;
+            case 'r':
+                settings.seed = strtoull(optarg, &endPointer, 10);
+                result = *endPointer != '\0' ? -1 : 0;
+                break;
+            case 'f':
+                settings.json = strcmp(optarg, "json") == 0;
+                result = settings.json || strcmp(optarg, "csv") == 0 ? 0 : -1;
+                break;
+            default:
+                result = -1;
+        }
+        if (result != 0) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < BENCH_OPERATIONS; i++) {
+        histograms[i] = createHistogram();
+    }
+    if (settings.json) {
+        printf("[");
+    } else {
+        printf("blocks,backend,policy,occupancy,operation,count,ops_per_sec,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+    }
+
+    for (i = 0; i < settings.sizeCount; i++) {
+        for (j = 0; j < settings.policyCount; j++) {
+            for (k = 0; k < settings.occupancyCount; k++) {
+                runBenchmark(&settings, settings.sizes[i], (int) settings.policies[j],
+                             (int) settings.occupancies[k], histograms);
+            }
+        }
+    }
+
+    if (settings.json) {
+        printf("\n]\n");
+    }
+    for (i = 0; i < BENCH_OPERATIONS; i++) {
+        destroyHistogram(&histograms[i]);
+    }
+    return 0;
+}
+
+/**
+ * Prints the command line options of the program.
+ *
+ * @param program Name the program was run as.
+ */
+void printUsage(const char* program) {
+    printf("Usage: %s [-s sizes] [-p policies] [-o occupancies] [-b blocks|extents] [-n operations] [-r seed] [-f csv|json]\n",
+           program);
+}
+
+/**
+ * Parses a comma separated list of positive numbers or placement policy names. Numbers may end
+ * in K or M to multiply them by a thousand or a million.
+ *
+ * @param text The list to be parsed.
+ * @param values Receives the parsed values, at most BENCH_MAX_LIST of them.
+ * @param count Receives the number of values parsed.
+ * @param isPolicy Nonzero if the list holds policy names rather than numbers.
+ * @return 0 if the whole list was valid, -1 otherwise.
+ */
+int parseList(const char* text, long* values, int* count, int isPolicy) {
+    char* copy = malloc(strlen(text) + 1);
+    char* item;
+    int result = 0;
+    strcpy(copy, text);
+
+    *count = 0;
+    for (item = strtok(copy, ","); item != NULL && result == 0; item = strtok(NULL, ",")) {
+        char* endPointer;
+        long value;
+        if (isPolicy) {
+            value = parsePolicy(item);
+            endPointer = "";
+        } else {
+            long scale = 1;
+            value = strtol(item, &endPointer, 10);
+            if (*endPointer == 'K' || *endPointer == 'k') {
+                scale = 1000;
+                endPointer++;
+            } else if (*endPointer == 'M' || *endPointer == 'm') {
+                scale = 1000000;
+                endPointer++;
+            }
+            // Checked before scaling so that large values are rejected instead of wrapping around.
+            value = *endPointer == '\0' && value > 0 && value <= MAX_TABLE_BLOCKS / scale ? value * scale : -1;
+        }
+        if (value < 0 || *count == BENCH_MAX_LIST) {
+            printf("Invalid list entry: %s\n", item);
+            result = -1;
+        } else {
+            values[(*count)++] = value;
+        }
+    }
+    free(copy);
+    return result == 0 && *count > 0 ? 0 : -1;
+}
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return The current time in nanoseconds.
+ */
+static inline uint64_t now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + (uint64_t) t.tv_nsec;
+}
+
+/**
+ * Draws the size of a new file, a whole number of blocks up to maxBlocks with a partly used last block.
+ */
+static long drawFileSize(uint64_t* state, long maxBlocks) {
+    long blocks = 1 + (long) (nextRandom(state) % (uint64_t) maxBlocks);
+    return (blocks - 1) * BENCH_BLOCK_SIZE + 1 + (long) (nextRandom(state) % BENCH_BLOCK_SIZE);
+}
+
+/**
+ * Benchmarks one combination of table size, policy and occupancy, then prints its results. The
+ * add and delete steps are the ones addFileToSystem() and deleteFileFromSystem() take, called
+ * one at a time so each can be timed; the duplicate check and compaction are left out.
+ *
+ * @param settings The settings from the command line.
+ * @param blocks Number of blocks in the table.
+ * @param policy Placement policy of the system.
+ * @param occupancy Percent of the blocks to fill before timing starts.
+ * @param histograms One Histogram per timed operation, reset before use.
+ */
+void runBenchmark(Settings* settings, long blocks, int policy, int occupancy, Histogram* histograms) {
+    MemorySystem system = createMemorySystem(blocks * BENCH_BLOCK_SIZE, BENCH_BLOCK_SIZE, policy,
+                                             settings->backend);
+    BlockTable* table = &system.table;
+    Directory* directory = &system.directory;
+    long maxBlocks = blocks / 64 < BENCH_MAX_FILE_BLOCKS ? blocks / 64 : BENCH_MAX_FILE_BLOCKS;
+    long* live = malloc(sizeof(long) * blocks);
+    long liveCount = 0, nextId = 0, i;
+    uint64_t state = settings->seed;
+    uint64_t begin;
+    char fileName[32];
+
+    for (i = 0; i < BENCH_OPERATIONS; i++) {
+        resetHistogram(&histograms[i]);
+    }
+    if (maxBlocks < 1) {
+        maxBlocks = 1;
+    }
+
+    // Fill the table up to the occupancy without timing anything.
+    while (table->blocksInUse < blocks / 100 * occupancy + blocks % 100 * occupancy / 100) {
+        snprintf(fileName, sizeof(fileName), "b%ld", nextId);
+        if (addFileToSystem(&system, fileName, drawFileSize(&state, maxBlocks)) != SYSTEM_OK) {
+            break;
+        }
+        live[liveCount++] = nextId++;
+    }
+
+    for (i = 0; i < settings->operations && liveCount > 0; i++) {
+        // Delete a random file.
+        long pick = (long) (nextRandom(&state) % (uint64_t) liveCount);
+        snprintf(fileName, sizeof(fileName), "b%ld", live[pick]);
+        live[pick] = live[--liveCount];
+
+        begin = now();
+        long handle = findEntryInDirectory(directory, fileName);
+        recordValue(&histograms[BENCH_FIND], now() - begin);
+
+        Entry* e = &directory->list[handle];
+        begin = now();
+        releaseTable(table, e->start, e->length);
+        releasePlacement(&system.placement, e->start, e->length);
+        recordValue(&histograms[BENCH_RELEASE], now() - begin);
+
+        begin = now();
+        deleteFromDirectory(directory, handle);
+        recordValue(&histograms[BENCH_DELETE_ENTRY], now() - begin);
+
+        // Add a new file in its place.
+        long fileSize = drawFileSize(&state, maxBlocks);
+        long blocksNeeded = blocksForSize(table, fileSize);
+
+        begin = now();
+        checkForSpace(table, fileSize);
+        recordValue(&histograms[BENCH_CHECK], now() - begin);
+
+        begin = now();
+        long start = choosePlacement(&system.placement, table, blocksNeeded);
+        recordValue(&histograms[BENCH_PLACE], now() - begin);
+        if (start < 0) {
+            continue;
+        }
+
+        snprintf(fileName, sizeof(fileName), "b%ld", nextId);
+        Entry newEntry = createEntry(fileName, fileSize, start, blocksNeeded);
+        begin = now();
+        updateTable(table, start, fileSize);
+        recordValue(&histograms[BENCH_UPDATE], now() - begin);
+
+        begin = now();
+        addToDirectory(directory, newEntry);
+        recordValue(&histograms[BENCH_ADD_ENTRY], now() - begin);
+        live[liveCount++] = nextId++;
+    }
+
+    printResults(settings, blocks, policy, occupancy, histograms);
+    free(live);
+    destroyMemorySystem(&system);
+}
+
+/**
+ * Prints one result row per timed operation of a benchmark run, as CSV or JSON objects.
+ * Throughput is the number of calls divided by the total time spent in them.
+ *
+ * @param settings The settings from the command line.
+ * @param blocks Number of blocks in the table.
+ * @param policy Placement policy of the system.
+ * @param occupancy Percent of the blocks filled before timing started.
+ * @param histograms One Histogram per timed operation.
+ */
+void printResults(Settings* settings, long blocks, int policy, int occupancy, Histogram* histograms) {
+    static int rows = 0;
+    int i;
+    for (i = 0; i < BENCH_OPERATIONS; i++) {
+        Histogram* h = &histograms[i];
+        double opsPerSecond = h->sum > 0 ? h->total / (h->sum / 1e9) : 0;
+        unsigned long long p50 = valueAtPercentile(h, 50);
+        unsigned long long p99 = valueAtPercentile(h, 99);
+        unsigned long long p999 = valueAtPercentile(h, 99.9);
+        unsigned long long max = h->total > 0 ? h->max : 0;
+
+        if (settings->json) {
+            printf("%s\n  {\"blocks\": %ld, \"backend\": \"%s\", \"policy\": \"%s\", \"occupancy\": %d, \"operation\": \"%s\", "
+                   "\"count\": %ld, \"ops_per_sec\": %.0f, \"mean_ns\": %.1f, \"p50_ns\": %llu, "
+                   "\"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+                   rows == 0 ? "" : ",", blocks, backendName(settings->backend), policyName(policy), occupancy, operationNames[i],
+                   h->total, opsPerSecond, histogramMean(h), p50, p99, p999, max);
+        } else {
+            printf("%ld,%s,%s,%d,%s,%ld,%.0f,%.1f,%llu,%llu,%llu,%llu\n",
+                   blocks, backendName(settings->backend), policyName(policy), occupancy, operationNames[i],
+                   h->total, opsPerSecond, histogramMean(h), p50, p99, p999, max);
+        }
+        rows++;
+    }
+    fflush(stdout);
+}
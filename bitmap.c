@@ -0,0 +1,301 @@
+//
+// bitmap.c
+//
+
+#include "bitmap.h"
+#include "scanStats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BITMAP_HAVE_AVX2 1
+#endif
+
+#define ALL_SET (~(uint64_t) 0)
+
+
+/**
+ * Creates a new bitmap with every bit clear.
+ *
+ * @param bits Number of bits in the map.
+ * @return The words of the bitmap, to be released with destroyBitmap().
+ */
+uint64_t* createBitmap(long bits) {
+    uint64_t* bitmap = malloc(sizeof(uint64_t) * bitmapWords(bits));
+    clearBitmap(bitmap, bits);
+    return bitmap;
+}
+
+
+/**
+ * Changes the number of bits in a bitmap, keeping the bits both sizes share. Bits added at the end
+ * start out clear, and the padding past the new last bit is kept set. Only the words at the end of
+ * the map are touched, and the words are reallocated in place where the allocator can.
+ *
+ * @param bitmap The bitmap to be resized.
+ * @param oldBits Number of bits in the map now.
+ * @param newBits Number of bits the map should hold.
+ * @return The words of the resized bitmap, which replace the ones passed in.
+ */
+uint64_t* resizeBitmap(uint64_t* bitmap, long oldBits, long newBits) {
+    long oldWords = bitmapWords(oldBits);
+    long newWords = bitmapWords(newBits);
+    if (newBits < oldBits) {
+        setBitRange(bitmap, newBits, oldBits);  // Becomes padding, the rest of the word already is.
+        return realloc(bitmap, sizeof(uint64_t) * newWords);
+    }
+    bitmap = realloc(bitmap, sizeof(uint64_t) * newWords);
+    if (newWords > oldWords) {
+        memset(bitmap + oldWords, 0xFF, sizeof(uint64_t) * (newWords - oldWords));
+    }
+    clearBitRange(bitmap, oldBits, newBits);
+    return bitmap;
+}
+
+
+/**
+ * Frees the memory held by a bitmap.
+ *
+ * @param bitmap The bitmap to be destroyed.
+ */
+void destroyBitmap(uint64_t* bitmap) {
+    free(bitmap);
+}
+
+
+/**
+ * Clears every bit of a bitmap, keeping the padding past the last bit set.
+ *
+ * @param bitmap The bitmap to be cleared.
+ * @param bits Number of bits in the map.
+ */
+void clearBitmap(uint64_t* bitmap, long bits) {
+    long words = bitmapWords(bits);
+    memset(bitmap, 0, sizeof(uint64_t) * words);
+    if (bits % BITMAP_WORD_BITS != 0) {
+        bitmap[words - 1] = ALL_SET << (bits % BITMAP_WORD_BITS);
+    }
+}
+
+
+/**
+ * Sets or clears the bits [from, to) of a bitmap. Whole words in the middle of the range are
+ * filled with memset, only the words at either end are masked.
+ */
+static void fillBitRange(uint64_t* bitmap, long from, long to, int value) {
+    if (from >= to) {
+        return;
+    }
+    long first = from / BITMAP_WORD_BITS;
+    long last = (to - 1) / BITMAP_WORD_BITS;
+    uint64_t headMask = ALL_SET << (from % BITMAP_WORD_BITS);
+    uint64_t tailMask = ALL_SET >> (BITMAP_WORD_BITS - 1 - (to - 1) % BITMAP_WORD_BITS);
+
+    if (first == last) {
+        headMask &= tailMask;
+    } else {
+        memset(bitmap + first + 1, value ? 0xFF : 0, sizeof(uint64_t) * (last - first - 1));
+        bitmap[last] = value ? bitmap[last] | tailMask : bitmap[last] & ~tailMask;
+    }
+    bitmap[first] = value ? bitmap[first] | headMask : bitmap[first] & ~headMask;
+}
+
+
+/**
+ * Sets every bit in a range of a bitmap, a word at a time.
+ *
+ * @param bitmap The bitmap being updated.
+ * @param from First bit of the range.
+ * @param to One past the last bit of the range.
+ */
+void setBitRange(uint64_t* bitmap, long from, long to) {
+    fillBitRange(bitmap, from, to, 1);
+}
+
+
+/**
+ * Clears every bit in a range of a bitmap, a word at a time.
+ *
+ * @param bitmap The bitmap being updated.
+ * @param from First bit of the range.
+ * @param to One past the last bit of the range.
+ */
+void clearBitRange(uint64_t* bitmap, long from, long to) {
+    fillBitRange(bitmap, from, to, 0);
+}
+
+
+/**
+ * Scalar version of skipWords().
+ */
+static long skipWordsScalar(const uint64_t* words, long from, long end, uint64_t value) {
+    while (from < end && words[from] == value) {
+        from++;
+    }
+    return from;
+}
+
+
+#ifdef BITMAP_HAVE_AVX2
+/**
+ * AVX2 version of skipWords(), compares four words per instruction.
+ */
+__attribute__((target("avx2")))
+static long skipWordsAvx2(const uint64_t* words, long from, long end, uint64_t value) {
+    __m256i target = _mm256_set1_epi64x((long long) value);
+    while (from + 4 <= end) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*) (words + from));
+        int equal = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(chunk, target)));
+        if (equal != 0xF) {
+            return from + __builtin_ctz(~equal & 0xF);
+        }
+        from += 4;
+    }
+    return skipWordsScalar(words, from, end, value);
+}
+#endif
+
+
+/* The skipWords() version this CPU runs, chosen once by chooseSkipWords(). */
+static long (*skipWordsImplementation)(const uint64_t*, long, long, uint64_t) = skipWordsScalar;
+static pthread_once_t skipWordsChosen = PTHREAD_ONCE_INIT;
+
+
+/**
+ * Picks the AVX2 version of skipWords() when the CPU supports it. Run through pthread_once, so
+ * threads searching bitmaps at the same time all see the choice made exactly once.
+ */
+static void chooseSkipWords(void) {
+#ifdef BITMAP_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        skipWordsImplementation = skipWordsAvx2;
+    }
+#endif
+}
+
+
+/**
+ * Finds the first word at or after from, and before end, that does not equal value. Uses the
+ * AVX2 version when the CPU supports it, checked once on first use.
+ *
+ * @return Index of the first differing word, or end if every word matches.
+ */
+static long skipWords(const uint64_t* words, long from, long end, uint64_t value) {
+    pthread_once(&skipWordsChosen, chooseSkipWords);
+    return skipWordsImplementation(words, from, end, value);
+}
+
+
+/**
+ * Finds the positions within a word where a run of the given number of set bits begins.
+ * Only runs that fit entirely inside the word are reported.
+ *
+ * @param bits The word to be searched.
+ * @param length Run length, between 1 and 64.
+ * @return A word with bit p set if bits p through p + length - 1 are all set.
+ */
+static uint64_t runStarts(uint64_t bits, long length) {
+    long covered = 1;
+    while (covered < length && bits != 0) {
+        long shift = covered < length - covered ? covered : length - covered;
+        bits &= bits >> shift;
+        covered += shift;
+    }
+    return bits;
+}
+
+
+/**
+ * Finds the first run of clear bits of the given length, one 64-bit word at a time. Words that
+ * are entirely set or entirely clear are skipped in bulk, and runs inside a partially used word
+ * are found with count-trailing-zeros and shift-and masks instead of testing bit by bit.
+ *
+ * @param bitmap The bitmap to be searched.
+ * @param bits Number of bits in the map.
+ * @param from Lowest bit index the run may start at.
+ * @param length Number of clear bits needed.
+ * @return Index of the first bit of the run, or -1 if no run is long enough.
+ */
+long findClearRun(const uint64_t* bitmap, long bits, long from, long length) {
+    long words = bitmapWords(bits);
+    long run = 0;        // Clear bits carried over from previous words.
+    long runStart = 0;   // Index of the first of those carried bits.
+    long word;
+
+    if (length <= 0 || from < 0 || from + length > bits) {
+        return -1;
+    }
+
+    word = from / BITMAP_WORD_BITS;
+    uint64_t current = bitmap[word] | ~(ALL_SET << (from % BITMAP_WORD_BITS));  // Ignore bits before from.
+    while (word < words) {
+        if (current == 0) {  // Whole word free, extend the run over every following free word too.
+            long next = skipWords(bitmap, word + 1, words, 0);
+            COUNT_SCAN(wordsExamined, next - word);
+            if (run == 0) {
+                runStart = word * BITMAP_WORD_BITS;
+            }
+            run += (next - word) * BITMAP_WORD_BITS;
+            if (run >= length) {
+                return runStart;
+            }
+            word = next;
+        } else if (current == ALL_SET) {  // Whole word used, skip every following used word too.
+            long next = skipWords(bitmap, word + 1, words, ALL_SET);
+            COUNT_SCAN(wordsExamined, next - word);
+            run = 0;
+            word = next;
+        } else {
+            COUNT_SCAN(wordsExamined, 1);
+            long trailing = __builtin_ctzll(current);
+            if (run + trailing >= length) {
+                return run == 0 ? word * BITMAP_WORD_BITS : runStart;
+            }
+            if (length < BITMAP_WORD_BITS) {
+                uint64_t starts = runStarts(~current, length);
+                if (starts != 0) {
+                    return word * BITMAP_WORD_BITS + __builtin_ctzll(starts);
+                }
+            }
+            run = __builtin_clzll(current);
+            runStart = (word + 1) * BITMAP_WORD_BITS - run;
+            word++;
+        }
+        current = word < words ? bitmap[word] : ALL_SET;
+    }
+    return -1;
+}
+
+
+/**
+ * Counts the set bits in the range [from, to) with one popcount per word.
+ *
+ * @param bitmap The bitmap to be counted.
+ * @param from Index of the first bit to count.
+ * @param to Index one past the last bit to count.
+ * @return The number of set bits in the range.
+ */
+long countSetBits(const uint64_t* bitmap, long from, long to) {
+    long count = 0;
+    long word;
+    if (from >= to) {
+        return 0;
+    }
+
+    long first = from / BITMAP_WORD_BITS;
+    long last = (to - 1) / BITMAP_WORD_BITS;
+    uint64_t lowMask = ALL_SET << (from % BITMAP_WORD_BITS);
+    uint64_t highMask = ALL_SET >> (BITMAP_WORD_BITS - 1 - ((to - 1) % BITMAP_WORD_BITS));
+    if (first == last) {
+        return __builtin_popcountll(bitmap[first] & lowMask & highMask);
+    }
+
+    count += __builtin_popcountll(bitmap[first] & lowMask);
+    for (word = first + 1; word < last; word++) {
+        count += __builtin_popcountll(bitmap[word]);
+    }
+    count += __builtin_popcountll(bitmap[last] & highMask);
+    return count;
+}
@@ -0,0 +1,46 @@
+//
+// bitmap.h
+//
+
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+
+/*
+ * Packed bitmaps of 64-bit words, bit i of the map lives in bit (i % 64) of word (i / 64).
+ * Bits past the end of the map are kept set so that searches for clear runs never run off
+ * the end of the last word.
+ */
+
+#define BITMAP_WORD_BITS 64
+
+uint64_t* createBitmap(long bits);
+uint64_t* resizeBitmap(uint64_t* bitmap, long oldBits, long newBits);
+void destroyBitmap(uint64_t* bitmap);
+void clearBitmap(uint64_t* bitmap, long bits);
+void setBitRange(uint64_t* bitmap, long from, long to);
+void clearBitRange(uint64_t* bitmap, long from, long to);
+long findClearRun(const uint64_t* bitmap, long bits, long from, long length);
+long countSetBits(const uint64_t* bitmap, long from, long to);
+
+/**
+ * Number of 64-bit words needed to hold a bitmap of the given size.
+ */
+static inline long bitmapWords(long bits) {
+    return (bits + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+}
+
+static inline int testBit(const uint64_t* bitmap, long bit) {
+    return (bitmap[bit / BITMAP_WORD_BITS] >> (bit % BITMAP_WORD_BITS)) & 1;
+}
+
+static inline void setBit(uint64_t* bitmap, long bit) {
+    bitmap[bit / BITMAP_WORD_BITS] |= (uint64_t) 1 << (bit % BITMAP_WORD_BITS);
+}
+
+static inline void clearBit(uint64_t* bitmap, long bit) {
+    bitmap[bit / BITMAP_WORD_BITS] &= ~((uint64_t) 1 << (bit % BITMAP_WORD_BITS));
+}
+
+#endif
@@ -2,8 +2,12 @@
 // directory.c by Brandon Morris on 2019-10-31.
 //
 #include "blockTable.h"
+#include "bitmap.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+static const char* backendNames[TABLE_BACKEND_COUNT] = {"blocks", "extents"};
 
 /**
  * Creates a new Block object.
@@ -14,7 +18,7 @@
  * @param size of the new Block.
  * @return A Block object of with size = size, with other values initialized to 0.
  */
-Block createBlock(int size) {
+Block createBlock(long size) {
     Block newBlock;
     newBlock.size = size;
     newBlock.used = 0;
@@ -26,57 +30,119 @@ Block createBlock(int size) {
 
 
 /**
- * Updates a Block object to have new values based on the way the system is now using it's memory.
+ * Assembles a Block object from the columns of a BlockTable.
  *
- * @param block The Block object being modified.
- * @param newUsed The amount of space the Block object is now using.
+ * @param bTable The BlockTable holding the Block.
+ * @param index The index of the Block.
+ * @return A copy of the Block's current values.
  */
-void updateBlock(Block* block, int newUsed) {
-    block->used = newUsed;
-    block->fragmented = block->size - newUsed;
+Block getBlock(BlockTable* bTable, long index) {
+    Block b = createBlock(bTable->blockSize);
+    if (bTable->backend == TABLE_EXTENTS) {
+        ExtentNode* run = findFloorExtent(&bTable->allocated, index);
+        if (run != NULL && index < run->start + run->length) {
+            b.inUse = 1;
+            b.used = index == run->start + run->length - 1 ? run->owner : bTable->blockSize;
+            b.fragmented = bTable->blockSize - b.used;
+        }
+        return b;
+    }
+    b.inUse = blockInUse(bTable, index);
+    b.fragmented = bTable->fragmented[index];
+    b.used = b.inUse ? bTable->blockSize - b.fragmented : 0;
+    return b;
+}
 
-    // Update inUse member field. If it is using space, make it true for inUse.
-    // If the blockTable is now using none of its memory, reset it to default values.
-    if (block->inUse == 0) {
-        block->inUse = 1;
-    } else if (block->inUse == 1 && block->used == 0) {
-        resetBlock(block);
+
+/**
+ * Checks whether a Block of a BlockTable is in use. Takes constant time with the TABLE_BLOCKS
+ * backend and logarithmic time in the number of allocated runs with TABLE_EXTENTS.
+ *
+ * @param bTable The BlockTable holding the Block.
+ * @param index The index of the Block.
+ * @return 1 if the Block is in use, 0 otherwise.
+ */
+int blockInUse(BlockTable* bTable, long index) {
+    if (bTable->backend == TABLE_EXTENTS) {
+        ExtentNode* run = findFloorExtent(&bTable->allocated, index);
+        return run != NULL && index < run->start + run->length;
     }
+    return testBit(bTable->inUse, index);
 }
 
 
 /**
- * Resets a Block object to its default state, where used, fragmented, and inUse all equal zero.
+ * Updates a Block to have new values based on the way the system is now using it's memory.
+ * The table's running totals are adjusted by the change. Only valid for the TABLE_BLOCKS backend,
+ * the TABLE_EXTENTS backend is only ever updated a whole run at a time.
  *
- * @param block The Block to be reset.
+ * @param bTable The BlockTable holding the Block.
+ * @param index The index of the Block being modified.
+ * @param newUsed The amount of space the Block is now using.
  */
-void resetBlock(Block* block) {
-    block->used = 0;
-    block->fragmented = 0;
-    block->inUse = 0;
+void updateBlock(BlockTable* bTable, long index, long newUsed) {
+    int wasInUse = testBit(bTable->inUse, index);
+    long oldUsed = wasInUse ? bTable->blockSize - bTable->fragmented[index] : 0;
+    bTable->usedBytes += newUsed - oldUsed;
+    bTable->fragmentedBytes += (bTable->blockSize - newUsed) - bTable->fragmented[index];
+    bTable->fragmented[index] = (int) (bTable->blockSize - newUsed);
+
+    // Update the inUse bit. If it is using space, set the bit.
+    // If the Block is now using none of its memory, reset it to default values.
+    if (!wasInUse) {
+        setBit(bTable->inUse, index);
+        bTable->blocksInUse++;
+    } else if (newUsed == 0) {
+        resetBlock(bTable, index);
+    }
 }
 
 
 /**
- * Creates a new BlockTable object that uses a dynamically allocated array of Block objects
- * to represent the state of system memory. Only one BlockTable object should exist.
+ * Resets a Block to its default state, where used, fragmented, and inUse all equal zero.
+ * The table's running totals are adjusted by the change. Only valid for the TABLE_BLOCKS backend.
  *
- * @param blockSize Size of each block within the table.
- * @param length Length of the table
- * @return A BlockTable object that has a dynamically allocated array of Block objects, all set
- *         to their default values.
+ * @param bTable The BlockTable holding the Block.
+ * @param index The index of the Block to be reset.
  */
-BlockTable createBlockTable(int blockSize, int length) {
+void resetBlock(BlockTable* bTable, long index) {
+    if (testBit(bTable->inUse, index)) {
+        bTable->usedBytes -= bTable->blockSize - bTable->fragmented[index];
+        bTable->blocksInUse--;
+    }
+    bTable->fragmentedBytes -= bTable->fragmented[index];
+    bTable->fragmented[index] = 0;
+    clearBit(bTable->inUse, index);
+}
+
+
+/**
+ * Creates a new BlockTable object. With the TABLE_BLOCKS backend the state of system memory is
+ * kept in dynamically allocated columns with an entry per block. With TABLE_EXTENTS nothing is
+ * allocated per block, so creating the table takes constant time whatever its length.
+ * Only one BlockTable object should exist.
+ *
+ * @param blockSize Size of each block within the table, at most MAX_BLOCK_SIZE.
+ * @param length Length of the table, at most MAX_TABLE_BLOCKS.
+ * @param backend TABLE_BLOCKS or TABLE_EXTENTS.
+ * @return A BlockTable object whose blocks are all set to their default values.
+ */
+BlockTable createBlockTable(long blockSize, long length, int backend) {
     BlockTable newTable;
+    newTable.backend = backend;
     newTable.blockSize = blockSize;
     newTable.length = length;
-    newTable.table = malloc(sizeof(struct blockTable) * length);
-
-    int i;
-    for (i = 0; i < length; i ++) {
-        Block b = createBlock(blockSize);
-        *(newTable.table + (sizeof(Block) * i)) = b;
+    newTable.inUse = NULL;
+    newTable.fragmented = NULL;
+    if (backend == TABLE_BLOCKS) {
+        newTable.inUse = createBitmap(length);
+        newTable.fragmented = calloc(length, sizeof(int));
     }
+    newTable.allocated = createExtentTree(ORDER_BY_START);
+    newTable.freeIndex = createFreeIndex(length);
+    newTable.usedBytes = 0;
+    newTable.fragmentedBytes = 0;
+    newTable.blocksInUse = 0;
 
     return newTable;
 }
@@ -88,77 +154,333 @@ BlockTable createBlockTable(int blockSize, int length) {
  * @param table The BlockTable object to be destroyed.
  */
 void destroyBlockTable(BlockTable* bTable) {
-    free(bTable->table);
+    destroyBitmap(bTable->inUse);
+    free(bTable->fragmented);
+    destroyExtentTree(&bTable->allocated);
+    destroyFreeIndex(&bTable->freeIndex);
 }
 
 
 /**
- * Updates the Block at the specified index within a BlockTable to use a new amount of memory.
- * If the size of the file is greater than one individual block, the update multiple blocks until the
- * BlockTable is fully updated, starting at the given index.
+ * Updates the Blocks starting at the specified index within a BlockTable to hold a file of the
+ * given size. Every Block of the file but the last is filled to capacity, the last holds the rest.
+ * The whole run is marked at once: with the TABLE_BLOCKS backend the occupancy bitmap is filled a
+ * word at a time and only the last Block's fragmented value is written, since free Blocks already
+ * hold zero there.
  *
  * NO BOUNDS CHECKING IS PERFORMED FOR THE UPDATE! It is the function caller's responsibility to check
  * for adequate space to store a file before calling this function. Space checking logic is handled by
- * checkForSpace() in the driver.c file before calling this function.
+ * checkForSpace() in the memorySystem.c file before calling this function. The blocks being updated
+ * must not already be in use, as they are removed from the table's free index.
  *
  * @param bTable The BlockTable being updated.
- * @param index The index of the Block to be updated.
- * @param sizeUsed The new amount of space the Block will now be using.
+ * @param index The index of the first Block to be updated.
+ * @param sizeUsed The size of the file stored in the Blocks.
  */
-void updateTable(BlockTable* bTable, int index, int sizeUsed) {
-    if (index > bTable->length || index < 0) {
+void updateTable(BlockTable* bTable, long index, long sizeUsed) {
+    if (index >= bTable->length || index < 0) {
         printf("Out of bounds: Block Table not updated.");
+        return;
+    }
+
+    reserveExtent(&bTable->freeIndex, index, (sizeUsed - 1) / bTable->blockSize + 1);
+    claimTable(bTable, index, sizeUsed);
+}
+
+
+/**
+ * Does the work of updateTable() apart from the free index: marks the Blocks of a file in use in
+ * the backend's columns and adds them to the running totals. For callers that have already taken
+ * the Blocks out of the free index themselves, see deferReserve().
+ *
+ * @param bTable The BlockTable being updated.
+ * @param index The index of the first Block to be updated.
+ * @param sizeUsed The size of the file stored in the Blocks.
+ */
+void claimTable(BlockTable* bTable, long index, long sizeUsed) {
+    long blockSize = bTable->blockSize;
+    long numBlocks = (sizeUsed - 1) / blockSize + 1;  // Total number of blocks needed to store the file.
+    long lastUsed = sizeUsed - (numBlocks - 1) * blockSize;
+    bTable->usedBytes += sizeUsed;
+    bTable->fragmentedBytes += blockSize - lastUsed;
+    bTable->blocksInUse += numBlocks;
+
+    if (bTable->backend == TABLE_EXTENTS) {  // Record the whole run, only its last block can be partly used.
+        insertExtent(&bTable->allocated, index, numBlocks)->owner = lastUsed;
     } else {
-        int blockSize = bTable->blockSize;
-        if (sizeUsed < blockSize) {  // If size needed can fit in one block, just update that one.
-            updateBlock((bTable->table + (sizeof(Block) * index)), sizeUsed);
-        } else {  // If more than one block is needed to store the file, loop and update multiple blocks as needed.
-            int i;
-            int numBlocks;  // Total number of blocks needed to store the file.
-            if (sizeUsed % blockSize != 0) {
-                numBlocks = (sizeUsed / blockSize) + 1;
-            } else {
-                numBlocks = sizeUsed / blockSize;
-            }
-            for (i = 0; i < numBlocks; i++) {
-                if (sizeUsed > blockSize) {  // Happens while we are filling blocks to max capacity
-                    updateBlock((bTable->table + (sizeof(Block) * (index + i))), blockSize);
-                    sizeUsed -= blockSize;
-                } else {  // Last update of the loop, update the final block with the remainder memory.
-                    updateBlock((bTable->table + (sizeof(Block) * (index + i))), sizeUsed);
-                }
-            }
-        }
+        bTable->fragmented[index + numBlocks - 1] = (int) (blockSize - lastUsed);
+        setBitRange(bTable->inUse, index, index + numBlocks);
     }
 }
 
 
+/**
+ * Resets a run of Blocks within a BlockTable, returning them to the table's free index.
+ * Used when a file is deleted from the system. The run must be exactly one that was given to
+ * updateTable() or claimTable(), so every Block of it is in use and only the last can be partly
+ * used.
+ *
+ * @param bTable The BlockTable being updated.
+ * @param index The index of the first Block to be reset.
+ * @param length The number of Blocks to be reset.
+ */
+void releaseTable(BlockTable* bTable, long index, long length) {
+    long fragmented;
+    if (bTable->backend == TABLE_EXTENTS) {
+        fragmented = bTable->blockSize - findFloorExtent(&bTable->allocated, index)->owner;
+        removeExtent(&bTable->allocated, index, length);
+    } else {  // Only the last block's column can be set, then clear the bits a word at a time.
+        fragmented = bTable->fragmented[index + length - 1];
+        bTable->fragmented[index + length - 1] = 0;
+        clearBitRange(bTable->inUse, index, index + length);
+    }
+    bTable->usedBytes -= length * bTable->blockSize - fragmented;
+    bTable->fragmentedBytes -= fragmented;
+    bTable->blocksInUse -= length;
+    releaseExtent(&bTable->freeIndex, index, length);
+}
+
+
+/**
+ * Moves a run of in-use Blocks to a lower index, as when a file is slid down during compaction.
+ * Every Block between the destination and the start of the run must be free. The Blocks left
+ * behind are reset, and the table's free index is updated to match.
+ *
+ * @param bTable The BlockTable being updated.
+ * @param from The index of the first Block of the run.
+ * @param to The index the first Block is moved to, lower than from.
+ * @param length The number of Blocks in the run.
+ */
+void moveBlocks(BlockTable* bTable, long from, long to, long length) {
+    if (bTable->backend == TABLE_EXTENTS) {  // The run keeps its last block's usage, only its start changes.
+        long tail = findFloorExtent(&bTable->allocated, from)->owner;
+        removeExtent(&bTable->allocated, from, length);
+        insertExtent(&bTable->allocated, to, length)->owner = tail;
+        releaseExtent(&bTable->freeIndex, from, length);
+        reserveExtent(&bTable->freeIndex, to, length);
+        return;
+    }
+
+    memmove(bTable->fragmented + to, bTable->fragmented + from, sizeof(int) * length);
+
+    // Free the old location first so it merges with the gap in front of it, then take the new one.
+    // The moved Blocks keep their values, so the table's running totals do not change.
+    long vacated = from > to + length ? from : to + length;
+    long claimed = from < to + length ? from : to + length;
+    memset(bTable->fragmented + vacated, 0, sizeof(int) * (from + length - vacated));
+    clearBitRange(bTable->inUse, vacated, from + length);
+    setBitRange(bTable->inUse, to, claimed);
+    releaseExtent(&bTable->freeIndex, from, length);
+    reserveExtent(&bTable->freeIndex, to, length);
+}
+
+
 /**
  * Resets the data for every Block within a BlockTable.
  *
  * @param bTable The BlockTable to have it's contents reset.
  */
 void clearTable(BlockTable* bTable) {
-    int i;
-    // Reset the Block at every index of the BlockTable provided.
-    for (i = 0; i < bTable->length; i++) {
-        resetBlock((bTable->table + (sizeof(Block) * i)));
+    // Reset the Block at every index of the BlockTable provided, a whole column at a time.
+    if (bTable->backend == TABLE_BLOCKS) {
+        clearBitmap(bTable->inUse, bTable->length);
+        memset(bTable->fragmented, 0, sizeof(int) * bTable->length);
     }
+    clearExtentTree(&bTable->allocated);
+    bTable->usedBytes = 0;
+    bTable->fragmentedBytes = 0;
+    bTable->blocksInUse = 0;
+    resetFreeIndex(&bTable->freeIndex, bTable->length);
 
 }
 
 
 /**
- * Prints the contents of the BlockTable to console.
+ * Grows or shrinks a BlockTable in place. Only the end of the table is touched: the per-block
+ * columns are reallocated and their new blocks cleared, and the blocks added or removed are
+ * released into or taken out of the free index as one extent, so resizing costs time in the
+ * number of blocks added or removed rather than in the size of the table. A table can only
+ * shrink if every block being removed is free.
+ *
+ * @param bTable The BlockTable to be resized.
+ * @param newLength The number of blocks the table should hold, at most MAX_TABLE_BLOCKS.
+ * @return 0 if the table was resized, -1 if a block past newLength is in use.
+ */
+int resizeTable(BlockTable* bTable, long newLength) {
+    long oldLength = bTable->length;
+    if (newLength < oldLength) {
+        ExtentNode* tail = findFloorExtent(&bTable->freeIndex.byStart, newLength);
+        if (tail == NULL || tail->start + tail->length != oldLength) {
+            return -1;
+        }
+        reserveExtent(&bTable->freeIndex, newLength, oldLength - newLength);
+    } else if (newLength > oldLength) {
+        releaseExtent(&bTable->freeIndex, oldLength, newLength - oldLength);
+    }
+
+    if (bTable->backend == TABLE_BLOCKS && newLength != oldLength) {
+        bTable->inUse = resizeBitmap(bTable->inUse, oldLength, newLength);
+        bTable->fragmented = realloc(bTable->fragmented, sizeof(int) * newLength);
+        if (newLength > oldLength) {
+            memset(bTable->fragmented + oldLength, 0, sizeof(int) * (newLength - oldLength));
+        }
+    }
+    bTable->length = newLength;
+    return 0;
+}
+
+
+/**
+ * Counts the Blocks of a BlockTable that are in use, using the occupancy bitmap. Tables without
+ * a bitmap report their running total instead.
+ *
+ * @param bTable The BlockTable to be counted.
+ * @return The number of Blocks in use.
+ */
+long countBlocksInUse(BlockTable* bTable) {
+    if (bTable->backend == TABLE_EXTENTS) {
+        return bTable->blocksInUse;
+    }
+    return countSetBits(bTable->inUse, 0, bTable->length);
+}
+
+
+/**
+ * Gathers the utilization and fragmentation of a BlockTable. Every value comes from a running
+ * total or from the root of the free index, so this takes constant time regardless of table size.
+ *
+ * @param bTable The BlockTable to be measured.
+ * @return The current TableMetrics of the table.
+ */
+TableMetrics getTableMetrics(BlockTable* bTable) {
+    TableMetrics m;
+    m.usedBytes = bTable->usedBytes;
+    m.fragmentedBytes = bTable->fragmentedBytes;
+    m.blocksInUse = bTable->blocksInUse;
+    m.freeBlocks = bTable->length - bTable->blocksInUse;
+    m.freeExtents = bTable->freeIndex.byStart.count;
+    m.largestFreeExtent = largestFreeExtent(&bTable->freeIndex);
+    return m;
+}
+
+
+/**
+ * Gives the memory a BlockTable of the given length needs for its per-block columns: the
+ * occupancy bitmap and the fragmented column with TABLE_BLOCKS, nothing with TABLE_EXTENTS.
+ *
+ * @param length Length of the table.
+ * @param backend TABLE_BLOCKS or TABLE_EXTENTS.
+ * @return The size of the columns in bytes.
+ */
+long columnBytes(long length, int backend) {
+    if (backend == TABLE_EXTENTS) {
+        return 0;
+    }
+    return bitmapWords(length) * (long) sizeof(uint64_t) + length * (long) sizeof(int);
+}
+
+
+/**
+ * Gives the memory a BlockTable is using: its per-block columns, and the nodes of its allocated
+ * runs and of both trees of its free index.
+ *
+ * @param bTable The BlockTable to be measured.
+ * @return The size of the table's columns and extent nodes in bytes.
+ */
+long tableMemory(BlockTable* bTable) {
+    FreeIndex* index = &bTable->freeIndex;
+    long nodes = bTable->allocated.count + index->byStart.count + index->byLength.count;
+    return columnBytes(bTable->length, bTable->backend) + nodes * (long) sizeof(ExtentNode);
+}
+
+
+/**
+ * Prints a summary of the utilization and fragmentation of a BlockTable to console.
+ *
+ * @param bTable The BlockTable to be summarized.
+ */
+void printTableMetrics(BlockTable* bTable) {
+    TableMetrics m = getTableMetrics(bTable);
+    printMetrics(&m, bTable->blockSize, bTable->length);
+}
+
+
+/**
+ * Prints a TableMetrics snapshot to console. Kept apart from printTableMetrics() so that the
+ * metrics of several tables can be added up and printed as one.
+ *
+ * @param m The metrics to be printed.
+ * @param blockSize Size of each block the metrics were gathered over.
+ * @param length Total number of blocks the metrics were gathered over.
+ */
+void printMetrics(TableMetrics* m, long blockSize, long length) {
+    long allocatedBytes = m->blocksInUse * blockSize;
+    printf("Blocks in use:\t\t%ld of %ld\n", m->blocksInUse, length);
+    printf("Bytes used:\t\t%ld\n", m->usedBytes);
+    printf("Internal fragmentation:\t%ld bytes", m->fragmentedBytes);
+    if (allocatedBytes > 0) {
+        printf(" (%.2f%% of allocated blocks)", 100.0 * m->fragmentedBytes / allocatedBytes);
+    }
+    printf("\n");
+    printf("Free blocks:\t\t%ld\n", m->freeBlocks);
+    printf("Free extents:\t\t%ld\n", m->freeExtents);
+    printf("Largest free extent:\t%ld blocks\n", m->largestFreeExtent);
+    if (m->freeBlocks > 0) {  // Share of free blocks that cannot be used by a file needing the largest extent.
+        printf("External fragmentation:\t%.2f%%\n", 100.0 * (m->freeBlocks - m->largestFreeExtent) / m->freeBlocks);
+    }
+}
+
+
+/**
+ * Prints the contents of the BlockTable to console. Tables using the TABLE_EXTENTS backend are
+ * printed a run at a time, since they may hold far more blocks than could be listed.
  *
  * @param bTable The BlockTable to be printed.
  */
 void printTable(BlockTable* bTable) {
-    int i;
+    long i;
     printf("Block table:\n");
+    if (bTable->backend == TABLE_EXTENTS) {
+        ExtentNode* run;
+        printf("Blocks\t\t\t\tLast block used\t\tFragmented\n");
+        for (run = findFirstExtent(&bTable->allocated); run != NULL;
+             run = findCeilingExtent(&bTable->allocated, run->start + run->length)) {
+            printf("%ld - %ld\t\t\t\t%ld\t\t\t\t%ld\n", run->start, run->start + run->length - 1,
+                   run->owner, bTable->blockSize - run->owner);
+        }
+        return;
+    }
     printf("Block number\t\tSize used\t\tFragmented\n");
     for (i = 0; i < bTable->length; i++) {
-        Block b = *(bTable->table + (sizeof(Block) * i));
-        printf("%d\t\t\t\t\t%d\t\t\t\t%d\n", i, b.used, b.fragmented);
+        Block b = getBlock(bTable, i);
+        printf("%ld\t\t\t\t\t%ld\t\t\t\t%ld\n", i, b.used, b.fragmented);
     }
 }
+
+
+/**
+ * Looks up a BlockTable backend by name.
+ *
+ * @param name Name of the backend, "blocks" or "extents".
+ * @return The TABLE_ constant of the backend, or -1 if the name is not recognized.
+ */
+int parseBackend(const char* name) {
+    int backend;
+    for (backend = 0; backend < TABLE_BACKEND_COUNT; backend++) {
+        if (strcmp(name, backendNames[backend]) == 0) {
+            return backend;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * Gives the name of a BlockTable backend.
+ *
+ * @param backend One of the TABLE_ constants.
+ * @return The name of the backend.
+ */
+const char* backendName(int backend) {
+    return backendNames[backend];
+}
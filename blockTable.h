@@ -5,39 +5,102 @@
 #ifndef BLOCK_H
 #define BLOCK_H
 
+#include "freeIndex.h"
+#include <stdint.h>
+#include <limits.h>
+
 typedef struct block Block;
 typedef struct blockTable BlockTable;
+typedef struct tableMetrics TableMetrics;
+
+/* Limits on the shape of a BlockTable. The fragmented column holds one int per block,
+ * so a block may not be larger than MAX_BLOCK_SIZE. MAX_TABLE_BLOCKS keeps the byte size of
+ * every per-block array, and of the directory sized from it, well inside a long. */
+#define MAX_BLOCK_SIZE INT_MAX
+#define MAX_TABLE_BLOCKS (1L << 48)
+
+/* Ways a BlockTable can store the state of its blocks. */
+#define TABLE_BLOCKS 0
+#define TABLE_EXTENTS 1
+#define TABLE_BACKEND_COUNT 2
 
 /**
- * Definition of the Block type. Holds information about particular sections of system memory
- * and is used by the BlockTable.
+ * Definition of the Block type. Holds information about particular sections of system memory.
+ * The BlockTable does not store Block objects directly, getBlock() assembles one from the
+ * table's columns when a whole Block is wanted.
  */
 struct block {
-    int size;
-    int used;
-    int fragmented;
+    long size;
+    long used;
+    long fragmented;
     int inUse;
 };
 
 /**
- * Definition of the BlockTable type. Used to store individual Block objects.
+ * Definition of the BlockTable type. With the TABLE_BLOCKS backend the state of every block is
+ * stored as separate columns: a packed occupancy bitmap (one bit per block, set while the block
+ * is in use) that the allocator searches, and the fragmented size of each block. A block in use
+ * holds blockSize minus its fragmented bytes, so no separate used column is kept and a run of
+ * blocks is claimed or freed by filling bitmap words rather than visiting every block. With the
+ * TABLE_EXTENTS backend those columns are not allocated at all; allocated holds one extent per
+ * run of blocks given to updateTable(), ordered by start, with the bytes used in the run's last
+ * block as its owner. Every other block of a run is full, so the table's memory grows with the
+ * number of files rather than the size of the device. The freeIndex mirrors which runs of blocks
+ * are not in use so free space can be found without a scan. usedBytes, fragmentedBytes and
+ * blocksInUse are running totals, kept up to date by every update so statistics never need to
+ * walk the table.
  */
 struct blockTable {
-    int blockSize;
-    int length;
-    Block *table;
+    int backend;
+    long blockSize;
+    long length;
+    uint64_t* inUse;
+    int* fragmented;
+    ExtentTree allocated;
+    FreeIndex freeIndex;
+    long usedBytes;
+    long fragmentedBytes;
+    long blocksInUse;
+};
+
+/**
+ * Definition of the TableMetrics type. A snapshot of the utilization and fragmentation of a
+ * BlockTable. fragmentedBytes is internal fragmentation, the unused tails of in-use blocks, and
+ * freeExtents and largestFreeExtent describe external fragmentation of the free blocks.
+ */
+struct tableMetrics {
+    long usedBytes;
+    long fragmentedBytes;
+    long blocksInUse;
+    long freeBlocks;
+    long freeExtents;
+    long largestFreeExtent;
 };
 
 /* Block functions. */
-Block createBlock(int size);
-void updateBlock(Block* block, int newUsed);
-void resetBlock(Block* block);
+Block createBlock(long size);
+Block getBlock(BlockTable* bTable, long index);
+void updateBlock(BlockTable* bTable, long index, long newUsed);
+void resetBlock(BlockTable* bTable, long index);
+int blockInUse(BlockTable* bTable, long index);
 
 /* BlockTable functions. */
-BlockTable createBlockTable(int blockSize, int length);
+BlockTable createBlockTable(long blockSize, long length, int backend);
 void destroyBlockTable(BlockTable* table);
-void updateTable(BlockTable* bTable, int index, int sizeUsed);
+void updateTable(BlockTable* bTable, long index, long sizeUsed);
+void claimTable(BlockTable* bTable, long index, long sizeUsed);
+void releaseTable(BlockTable* bTable, long index, long length);
+void moveBlocks(BlockTable* bTable, long from, long to, long length);
 void clearTable(BlockTable* bTable);
+int resizeTable(BlockTable* bTable, long newLength);
+long countBlocksInUse(BlockTable* bTable);
+TableMetrics getTableMetrics(BlockTable* bTable);
+long columnBytes(long length, int backend);
+long tableMemory(BlockTable* bTable);
+void printTableMetrics(BlockTable* bTable);
+void printMetrics(TableMetrics* m, long blockSize, long length);
 void printTable(BlockTable* bTable);
+int parseBackend(const char* name);
+const char* backendName(int backend);
 
 #endif
@@ -0,0 +1,67 @@
+//
+// compactor.c
+//
+
+#include "compactor.h"
+#include <stddef.h>
+
+
+/**
+ * Creates a new Compactor with all of its counters at zero.
+ *
+ * @param mode One of the COMPACT_ constants.
+ * @param stepBlocks Most blocks moved by one incremental step, only used by COMPACT_INCREMENTAL.
+ * @return A Compactor with the given settings.
+ */
+Compactor createCompactor(int mode, long stepBlocks) {
+    Compactor c;
+    c.mode = mode;
+    c.stepBlocks = stepBlocks;
+    c.passes = 0;
+    c.filesMoved = 0;
+    c.blocksMoved = 0;
+    c.rescuedAdds = 0;
+    return c;
+}
+
+
+/**
+ * Slides files down the BlockTable to close the gaps between them, rewriting the start of each
+ * moved file's Entry. Every move takes the lowest free gap and the file right behind it, so each
+ * call picks up where the last one stopped, and a table is fully compacted once every free block
+ * is at the end. Files are never split, so a single file larger than maxBlocks is still moved in
+ * one piece when it is the first file of the call.
+ *
+ * @param compactor The Compactor counting the work done.
+ * @param bTable The BlockTable being compacted.
+ * @param directory The Directory holding the Entry of every file in the table.
+ * @param maxBlocks Most blocks to move in this call, or a negative number to compact fully.
+ * @return The number of blocks moved.
+ */
+long compactTable(Compactor* compactor, BlockTable* bTable, Directory* directory, long maxBlocks) {
+    long moved = 0;
+    while (maxBlocks < 0 || moved < maxBlocks) {
+        ExtentNode* gap = findFirstExtent(&bTable->freeIndex.byStart);
+        if (gap == NULL) {
+            break;  // Table is full, nothing to close.
+        }
+        long gapStart = gap->start;
+        ExtentNode* file = findCeilingExtent(&directory->extents, gapStart);
+        if (file == NULL) {
+            break;  // No file after the first gap, the table is compacted.
+        }
+
+        long length = file->length;
+        if (maxBlocks >= 0 && moved > 0 && moved + length > maxBlocks) {
+            break;
+        }
+        long handle = file->owner;
+        moveBlocks(bTable, file->start, gapStart, length);
+        moveEntry(directory, handle, gapStart);
+        moved += length;
+        compactor->filesMoved++;
+    }
+
+    compactor->blocksMoved += moved;
+    return moved;
+}
@@ -0,0 +1,36 @@
+//
+// compactor.h
+//
+
+#ifndef COMPACTOR_H
+#define COMPACTOR_H
+
+#include "blockTable.h"
+#include "directory.h"
+
+typedef struct compactor Compactor;
+
+/* Compaction modes a MemorySystem can run with. */
+#define COMPACT_OFF 0
+#define COMPACT_FULL 1
+#define COMPACT_INCREMENTAL 2
+
+/**
+ * Definition of the Compactor type. Holds the compaction settings of a MemorySystem and counts
+ * the work compaction has done. In COMPACT_FULL mode a stop-the-world pass runs whenever a new
+ * file does not fit even though enough blocks are free in total. COMPACT_INCREMENTAL does the
+ * same, and also moves up to stepBlocks blocks between every pair of operations.
+ */
+struct compactor {
+    int mode;
+    long stepBlocks;
+    long passes;
+    long filesMoved;
+    long blocksMoved;
+    long rescuedAdds;
+};
+
+Compactor createCompactor(int mode, long stepBlocks);
+long compactTable(Compactor* compactor, BlockTable* bTable, Directory* directory, long maxBlocks);
+
+#endif
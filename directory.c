@@ -3,98 +3,370 @@
 //
 
 #include "directory.h"
+#include "scanStats.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#define EMPTY_SLOT -1
+
+
+/**
+ * Hashes a file name with 64-bit FNV-1a.
+ *
+ * @param fileName The name to be hashed.
+ * @return The hash of the name.
+ */
+unsigned long hashName(const char* fileName) {
+    unsigned long hash = 14695981039346656037UL;
+    while (*fileName != '\0') {
+        hash ^= (unsigned char) *fileName++;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+
+/**
+ * Finds the hash table slot holding the given file name, or the empty slot where it would go.
+ */
+static long findSlot(Directory* d, const char* fileName) {
+    long slot = hashName(fileName) & d->hashMask;
+    while (d->hashTable[slot] != EMPTY_SLOT
+           && strcmp(d->list[d->hashTable[slot]].fileName, fileName) != 0) {
+        slot = (slot + 1) & d->hashMask;
+    }
+    return slot;
+}
+
+
+#ifdef SCAN_STATS
+/**
+ * Number of names findSlot() compared on its way to the given slot: one for every occupied slot
+ * from the name's home slot up to and including the one it stopped at.
+ */
+static long probeLength(Directory* d, const char* fileName, long slot) {
+    long home = hashName(fileName) & d->hashMask;
+    return ((slot - home) & d->hashMask) + (d->hashTable[slot] != EMPTY_SLOT);
+}
+#endif
+
+
+/**
+ * Empties a hash table slot, shifting later entries of the same probe run back so that
+ * lookups never need tombstones.
+ */
+static void clearSlot(Directory* d, long slot) {
+    long next = slot;
+    d->hashTable[slot] = EMPTY_SLOT;
+    while (1) {
+        next = (next + 1) & d->hashMask;
+        if (d->hashTable[next] == EMPTY_SLOT) {
+            return;
+        }
+        long home = hashName(d->list[d->hashTable[next]].fileName) & d->hashMask;
+        // Move the entry back if its home slot is not between the hole and its current slot.
+        if (((next - home) & d->hashMask) >= ((next - slot) & d->hashMask)) {
+            d->hashTable[slot] = d->hashTable[next];
+            d->hashTable[next] = EMPTY_SLOT;
+            slot = next;
+            COUNT_SCAN(slotsMoved, 1);
+            COUNT_SCAN(bytesMoved, sizeof(long));
+        }
+    }
+}
+
 
 /**
- * Creates a new Directory object with space for 'length' number of Entry objects.
+ * Puts the slots [from, length) of a Directory on its free list, in order.
+ */
+static void freeSlots(Directory* d, long from) {
+    long i;
+    for (i = from; i < d->length; i++) {
+        d->list[i].fileName = NULL;
+        d->next[i] = i + 1 < d->length ? i + 1 : d->freeHead;
+    }
+    if (from < d->length) {
+        d->freeHead = from;
+    }
+}
+
+
+/**
+ * Allocates a name hash table large enough to stay at most half full with every slot of the
+ * Directory in use, and inserts the name of every Entry.
+ */
+static void buildHashTable(Directory* d) {
+    long capacity = 16;
+    long i;
+    while (capacity < d->length * 2) {
+        capacity *= 2;
+    }
+    d->hashTable = malloc(sizeof(long) * capacity);
+    d->hashMask = capacity - 1;
+    for (i = 0; i < capacity; i++) {
+        d->hashTable[i] = EMPTY_SLOT;
+    }
+    for (i = d->head; i >= 0; i = d->next[i]) {
+        d->hashTable[findSlot(d, d->list[i].fileName)] = i;
+    }
+}
+
+
+/**
+ * Grows a Directory to the given number of slots. Handles are slot indices, so every Entry keeps
+ * its handle, but pointers into list are no longer valid afterwards.
+ */
+static void growDirectory(Directory* d, long length) {
+    long oldLength = d->length;
+    d->length = length;
+    d->list = realloc(d->list, sizeof(Entry) * d->length);
+    d->next = realloc(d->next, sizeof(long) * d->length);
+    d->prev = realloc(d->prev, sizeof(long) * d->length);
+    freeSlots(d, oldLength);
+    free(d->hashTable);
+    buildHashTable(d);
+}
+
+
+/**
+ * Creates a new Directory object with space for 'length' number of Entry objects to start with.
+ * The Directory doubles its space whenever it fills up, so length only needs to be a guess.
  * The size of each directory initializes to zero and serves as a counter for the
- * number of Entry objects referenced by this Directory object.
+ * number of Entry objects referenced by this Directory object. Every slot starts out on
+ * the free list, and the name hash table is sized to stay at most half full.
  *
- * @param length The number of Entry objects this Directory can contain.
+ * @param length The number of Entry objects this Directory can contain before it grows.
  * @return A newly initialized Directory object.
  */
-Directory createDirectory(int length) {
+Directory createDirectory(long length) {
     Directory d;
     d.length = length;
     d.size = 0;
     d.list = malloc(sizeof(Entry) * length);
+    d.next = malloc(sizeof(long) * length);
+    d.prev = malloc(sizeof(long) * length);
+    d.head = -1;
+    d.tail = -1;
+    d.freeHead = -1;
+    d.names = createNameArena();
+    d.extents = createExtentTree(ORDER_BY_START);
+    freeSlots(&d, 0);
+    buildHashTable(&d);
     return d;
 }
 
 
 /**
- * Frees the dynamically allocated memory associated with a Directory object.
+ * Frees the dynamically allocated memory associated with a Directory object, including
+ * every file name, which are released all at once with the name arena.
  *
  * @param d The directory to have it's memory freed.
  */
 void destroyDirectory(Directory* d) {
     free(d->list);
+    free(d->next);
+    free(d->prev);
+    free(d->hashTable);
+    destroyNameArena(&d->names);
+    destroyExtentTree(&d->extents);
 }
 
 
 /**
- * Adds a new Entry to the specified Directory.
+ * Adds a new Entry to the specified Directory. File names must be unique, an Entry whose
+ * name is already in the Directory is not added. The Entry takes the first free slot and
+ * keeps it until it is deleted, the Directory grows if there is none. The Directory stores
+ * its own copy of the file name.
  *
  * @param d The Directory to Entry will be added to.
  * @param e The Entry object to be added.
+ * @return The handle of the new Entry, or -1 if the Directory already holds the name or the
+ *         name is too long.
  */
-void addToDirectory(Directory* d, Entry e) {
-    if (d->size == d->length) {
-        printf("Not enough space to add a new entry.");
+long addToDirectory(Directory* d, Entry e) {
+    long slot = findSlot(d, e.fileName);
+    if (d->hashTable[slot] != EMPTY_SLOT) {
+        printf("A file named %s already exists.\n", e.fileName);
+        return -1;
+    }
+    e.fileName = storeName(&d->names, e.fileName);
+    if (e.fileName == NULL) {
+        printf("File name is too long to add a new entry.");
+        return -1;
+    }
+    if (d->freeHead < 0) {  // Every slot is taken, grow and find the name's slot in the new hash table.
+        growDirectory(d, d->length > 0 ? d->length * 2 : 16);
+        slot = findSlot(d, e.fileName);
+    }
+
+    // Take a slot off of the free list and append it to the directory order.
+    long handle = d->freeHead;
+    d->freeHead = d->next[handle];
+    d->list[handle] = e;
+    d->prev[handle] = d->tail;
+    d->next[handle] = -1;
+    if (d->tail >= 0) {
+        d->next[d->tail] = handle;
     } else {
-        *(d->list + (sizeof(Entry) * d->size)) = e;
-        d->size++;
+        d->head = handle;
     }
+    d->tail = handle;
+
+    d->hashTable[slot] = handle;
+    insertExtent(&d->extents, e.start, e.length)->owner = handle;
+    d->size++;
+    return handle;
 }
 
 
 /**
- * Takes a Directory and deletes the Entry at the specified index by shifting
- * following Entry memory locations down, overwriting the deleted index and preserving
- * Directory
- * @param d
- * @param index
+ * Makes sure a Directory has room for a number of new entries without growing again, so a batch
+ * of adds grows it, and rebuilds its hash table, at most once. The Directory still at least
+ * doubles when it grows, keeping later adds amortised constant time.
+ *
+ * @param d The Directory entries will be added to.
+ * @param entries The number of entries about to be added.
  */
-void deleteFromDirectory(Directory* d, int index) {
-    int i, copyFlag, entrySize;
-    copyFlag = 0;
-    entrySize = sizeof(Entry);
-    for (i = 0; i < d->length; i++) {
-        if (i == index && copyFlag != 1) {
-            copyFlag = 1;
-        }
-        // If the copyFlag is true, shift the next Entry size chunk of memory down.
-        if (copyFlag == 1) {
-            memcpy((d->list + (entrySize * i)), (d->list + (entrySize * (i + 1))), entrySize);
-        }
-        // If the next iteration will be the index we want to delete at, set the copy flag True.
-        else if (i + 1 == index) {
-            copyFlag = 1;
-        }
+void reserveDirectory(Directory* d, long entries) {
+    long length = d->length > 0 ? d->length : 16;
+    if (d->size + entries <= d->length) {
+        return;
+    }
+    while (length < d->size + entries) {
+        length *= 2;
+    }
+    growDirectory(d, length);
+}
+
+
+/**
+ * Takes a Directory and deletes the Entry with the specified handle. The Entry is unlinked
+ * from the directory order and its slot is put back on the free list, so no other Entry moves
+ * and deletion takes constant time. The space used by the file name is reused by later entries.
+ *
+ * @param d The Directory to delete from.
+ * @param index The handle of the Entry to be deleted.
+ */
+void deleteFromDirectory(Directory* d, long index) {
+    COUNT_SCAN(deletes, 1);
+    clearSlot(d, findSlot(d, d->list[index].fileName));
+    removeExtent(&d->extents, d->list[index].start, d->list[index].length);
+
+    if (d->prev[index] >= 0) {
+        d->next[d->prev[index]] = d->next[index];
+    } else {
+        d->head = d->next[index];
+    }
+    if (d->next[index] >= 0) {
+        d->prev[d->next[index]] = d->prev[index];
+    } else {
+        d->tail = d->prev[index];
     }
 
+    releaseName(&d->names, d->list[index].fileName);
+    d->list[index].fileName = NULL;
+    d->next[index] = d->freeHead;
+    d->freeHead = index;
+
     // Deletion is done, update the Directory size.
     d->size--;
 }
 
 
+/**
+ * Records that the blocks of a file have been moved to a new location in the BlockTable.
+ *
+ * @param d The Directory holding the Entry.
+ * @param handle The handle of the Entry whose file moved.
+ * @param newStart The index of the first block of the file's new location.
+ */
+void moveEntry(Directory* d, long handle, long newStart) {
+    Entry* e = &d->list[handle];
+    removeExtent(&d->extents, e->start, e->length);
+    e->start = newStart;
+    insertExtent(&d->extents, e->start, e->length)->owner = handle;
+}
+
+
+/**
+ * Finds the file stored in a given block, from the Directory's extents in logarithmic time.
+ *
+ * @param d The Directory to be searched.
+ * @param block Index of the block in the BlockTable.
+ * @return The handle of the Entry whose blocks include the given one, or -1 if the block is free
+ *         or outside the table.
+ */
+long findEntryAtBlock(Directory* d, long block) {
+    ExtentNode* node = findFloorExtent(&d->extents, block);
+    if (node == NULL || block >= node->start + node->length) {
+        return -1;
+    }
+    return node->owner;
+}
+
+
+/**
+ * Lists the files with at least one block in the range [from, to), in block order, from the
+ * Directory's extents in logarithmic time plus the number of files found.
+ *
+ * @param d The Directory to be searched.
+ * @param from The first block of the range.
+ * @param to One past the last block of the range.
+ * @param handles Receives the handles of the first capacity Entries found.
+ * @param capacity Number of handles there is room for, may be 0 to only count the files.
+ * @return The number of files in the range, which may be more than capacity.
+ */
+long findEntriesInRange(Directory* d, long from, long to, long* handles, long capacity) {
+    if (to <= from) {
+        return 0;
+    }
+    ExtentNode* first = findFloorExtent(&d->extents, from);
+    if (first != NULL && from < first->start + first->length) {  // Starts before the range, but reaches into it.
+        from = first->start;
+    }
+    return collectExtentOwners(&d->extents, from, to, handles, capacity);
+}
+
+
+/**
+ * Gives the handle of the oldest Entry in a Directory, to start walking it in directory order.
+ *
+ * @param d The Directory to be walked.
+ * @return The handle of the first Entry, or -1 if the Directory is empty.
+ */
+long firstEntry(Directory* d) {
+    return d->head;
+}
+
+
+/**
+ * Gives the handle of the Entry added after the given one.
+ *
+ * @param d The Directory being walked.
+ * @param handle The handle of the current Entry.
+ * @return The handle of the next Entry, or -1 if the current Entry is the last one.
+ */
+long nextEntry(Directory* d, long handle) {
+    return d->next[handle];
+}
+
+
 void printDirectory(Directory* d) {
-    int i;
+    long i;
     printf("Directory table:\n");
     printf("Filename\t\t\t\t\t\tSize\t\tStart\t\tLength\n");
-    for (i = 0; i < d->size; i++) {
-        Entry e = *(d->list + (sizeof(Entry) * i));
-        printf("%s\t\t\t\t\t\t%d\t\t\t%d\t\t\t%d\n", e.fileName, e.size, e.start, e.length);
+    for (i = firstEntry(d); i >= 0; i = nextEntry(d, i)) {
+        Entry e = d->list[i];
+        printf("%s\t\t\t\t\t\t%ld\t\t\t%ld\t\t\t%ld\n", e.fileName, e.size, e.start, e.length);
     }
 }
 
 
 /**
  * Creates a new Entry object. Entry objects are used by the Directory object to
- * keep track of file names and indices where files begin and end in memory.
+ * keep track of file names and indices where files begin and end in memory. The Entry only
+ * refers to the given file name, addToDirectory() copies it into the Directory.
  *
  * @param fileName Name of the file this Entry refers to.
  * @param size Size the file holds in memory.
@@ -102,10 +374,9 @@ void printDirectory(Directory* d) {
  * @param length The number of Blocks this file spans in memory.
  * @return A newly initialized Entry object.
  */
-Entry createEntry(char *fileName, int size, int start, int length) {
+Entry createEntry(char *fileName, long size, long start, long length) {
     Entry e;
-    e.fileName = malloc(sizeof(char) * strlen(fileName));
-    strcpy(e.fileName, fileName);
+    e.fileName = fileName;
     e.size = size;
     e.start = start;
     e.length = length;
@@ -114,21 +385,19 @@ Entry createEntry(char *fileName, int size, int start, int length) {
 
 
 /**
- * Finds the index of a file within a Directory matching the desired file name. Used in conjunction
- * with deleteFromDirectory() to find desired files when attempting to remove them.
+ * Finds the handle of a file within a Directory matching the desired file name. Used in conjunction
+ * with deleteFromDirectory() to find desired files when attempting to remove them. The lookup goes
+ * through the name hash table, so it takes expected constant time.
  *
  * @param directory The Directory object to be searched.
  * @param fileName The name of the file in an Entry object to be searched for.
- * @return The index of the Entry in the Directory object if found, -1 if the Entry is not found.
- */
-int findEntryInDirectory(Directory* directory, char* fileName) {
-    int i, result;
-    result = -1;  // If no file matching the fileName given is found, return -1.
-    for (i = 0; i < directory->size; i++) {
-        if (strcmp( (directory->list + (sizeof(Entry) * i))->fileName, fileName) == 0) {
-            result = i;  // Found the file, return the index of the file in the directory.
-        }
-    }
-    return result;
+ * @return The handle of the Entry in the Directory object if found, -1 if the Entry is not found.
+ */
+long findEntryInDirectory(Directory* directory, char* fileName) {
+    long slot = findSlot(directory, fileName);
+    COUNT_SCAN(lookups, 1);
+    COUNT_SCAN(comparisons, probeLength(directory, fileName, slot));
+    // If no file matching the fileName given is found, the slot is empty and holds -1.
+    return directory->hashTable[slot];
 }
 
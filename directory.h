@@ -5,29 +5,66 @@
 #ifndef DIRECTORY_H
 #define DIRECTORY_H
 
+#include "nameArena.h"
+#include "extentTree.h"
+
 typedef struct directory Directory;
 typedef struct directory_entry Entry;
 
+/* Longest file name, including the terminating NUL, the system accepts. */
+#define MAX_FILE_NAME 64
+
 // TODO: Try putting these structs back into the .c file after testing.
+/*
+ * list is a slot map: an Entry keeps its position in list once added, so that position is a
+ * stable handle until the Entry is deleted. list doubles in length when every slot is taken.
+ * Unused slots have a NULL fileName and are chained through next, starting at freeHead. Used
+ * slots are chained through next and prev in the order they were added, from head to tail,
+ * which is the order printDirectory() lists them in.
+ *
+ * hashTable is an open-addressing (linear probing) index from file name to the handle of
+ * its Entry. Empty slots hold -1, and hashMask is the table's capacity minus one.
+ *
+ * The file names of all entries are owned by the Directory and live in its names arena.
+ * extents holds the block range of every Entry ordered by start, with the Entry's handle as
+ * the owner. It is the index from blocks back to files: the file stored at or after a given
+ * block, and the files in a range of blocks, are found in logarithmic time through it.
+ */
 struct directory {
-    int length;
-    int size;
+    long length;
+    long size;
     Entry* list;
+    long* next;
+    long* prev;
+    long head;
+    long tail;
+    long freeHead;
+    long* hashTable;
+    long hashMask;
+    NameArena names;
+    ExtentTree extents;
 };
 
 struct directory_entry {
     char* fileName;
-    int size;
-    int start;
-    int length;
-} directory_entry;
+    long size;
+    long start;
+    long length;
+};
 
-Directory createDirectory(int length);
+Directory createDirectory(long length);
 void destroyDirectory(Directory* d);
-void addToDirectory(Directory* d, Entry e);
-void deleteFromDirectory(Directory* d, int index);
-Entry createEntry(char *fileName, int size, int start, int length);
-int findEntryInDirectory(Directory* directory, char* fileName);
+long addToDirectory(Directory* d, Entry e);
+void reserveDirectory(Directory* d, long entries);
+void deleteFromDirectory(Directory* d, long index);
+Entry createEntry(char *fileName, long size, long start, long length);
+long findEntryInDirectory(Directory* directory, char* fileName);
+unsigned long hashName(const char* fileName);
+void moveEntry(Directory* d, long handle, long newStart);
+long findEntryAtBlock(Directory* d, long block);
+long findEntriesInRange(Directory* d, long from, long to, long* handles, long capacity);
+long firstEntry(Directory* d);
+long nextEntry(Directory* d, long handle);
 void printDirectory(Directory* d);
 
 #endif
@@ -9,39 +9,543 @@
  * block sizes must be such that the total system size is divisible by the block size
  * with no remainder. Try and enter bad values at certain points and to my knowledge, 
  * it won't let you.
+ *
+ * Usage:
+ *     pr1.out [options]                 Interactive mode, prompts for every value.
+ *     pr1.out [options] -u <socket>     Server mode, serves the system to local clients (see server.c).
+ *     pr1.out [options] <trace file>    Batch mode, replays a trace file (see trace.c) and prints a summary.
+ *     pr1.out [options] -g <workload>   Batch mode, generates a workload (see workload.c) and replays it.
+ *     pr1.out [options] -k <trace file> Self-check mode, also with -g, see selfCheck.c.
+ *
+ * Options:
+ *     -p <policy>    Placement policy for new files: first (default), next, best, worst, buddy or scan.
+ *     -b <backend>   How the block table is stored: blocks (default) keeps per-block columns, extents
+ *                    keeps one record per file so memory and startup time do not grow with the device.
+ *     -c <mode>      Compaction: "full" compacts the whole table when a file does not fit, a number
+ *                    of blocks also runs an incremental pass moving up to that many blocks between
+ *                    operations. Not available with buddy placement.
+ *     -g <workload>  Generate a synthetic workload from a list of key=value settings instead of
+ *                    reading a trace file, for example -g ops=50000,dist=zipf,seed=3.
+ *     -o <file>      With -g, write the generated workload to a trace file instead of replaying it.
+ *     -t <threads>   Replay with 1, 2, 4 ... up to this many threads against a device split into one
+ *                    shard per thread, printing how throughput scales. Operations on the same file
+ *                    stay on one thread and in trace order. Print and resize operations in the
+ *                    trace are skipped and compaction is not available.
+ *     -s <sweep>     Replay against every combination of the listed system sizes, block sizes and
+ *                    policies in parallel, one configuration per core (or per -t thread), and print a
+ *                    table comparing them, for example -s size=10M,block=512/1K/4K,policy=first/best.
+ *                    See sweep.c.
+ *     -r <file>      Start from a snapshot saved with -w or menu option 6 instead of an empty device.
+ *                    The snapshot's sizes replace those of the trace, and its placement policy is
+ *                    kept unless -p is given.
+ *     -w <file>      After replaying a trace or workload, save the final state as a snapshot.
+ *     -e <format>    Print the system as runs of blocks in the same state, in rle, csv or json format
+ *                    (see export.c), instead of one row per block, whenever the trace or the menu
+ *                    prints it.
+ *     -x <range>     Only print blocks first-last (inclusive) and the files among them, with -e or -d.
+ *     -d <file>      After replaying a trace or workload, export the final state to a file, in the
+ *                    -e format (rle by default).
+ *     -l <file>      Log every add, delete and failed add to a CSV file, with samples of the
+ *                    fragmentation metrics in between (see eventLog.c). Written by a background thread.
+ *     -i <count>     Operations between samples in the -l log (default 1000).
+ *     -a <count>     Add runs of consecutive adds in the trace as batches of up to count files, one
+ *                    addFilesToSystem() call per batch. With an s after the count (-a 64s) the
+ *                    largest files of every batch are added first, or with first-fit and scan
+ *                    placement, only when that places at least as many blocks as trace order.
+ *     -z <classes>   Split the device into size classes with block sizes of their own, for example
+ *                    -z 512/4K/64K, and route every file to the class that fits it best (see
+ *                    tieredSystem.c). The trace's block size is not used. Prints every class, and
+ *                    the fragmentation and table memory saved over a single block size. Print and
+ *                    resize operations in the trace are skipped.
+ *     -u <socket>    Instead of showing the menu, serve the system on a Unix domain socket at this
+ *                    path until a client sends shutdown or the program is interrupted. -w and -d
+ *                    save or export the final state once it stops.
+ *     -m <size>/<block>  Storage and block size of the device, for example -m 10M/4K, instead of
+ *                    prompting for them in interactive or server mode.
+ *     -k             Instead of printing a summary, replay the trace or workload against both block
+ *                    table backends and through a snapshot save and restore, with the -p policy or
+ *                    every policy, and fail if the final systems are not identical (see
+ *                    selfCheck.c). "make check" runs it on a generated workload.
+ *
+ * Built with "make SCAN_STATS=1", batch mode also reports how many free extents, bitmap words and
+ * file names the searches looked at during the replay (see scanStats.h).
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "directory.h"
 #include "blockTable.h"
+#include "memorySystem.h"
+#include "trace.h"
+#include "workload.h"
+#include "shardedSystem.h"
+#include "sweep.h"
+#include "snapshot.h"
+#include "export.h"
+#include "scanStats.h"
+#include "tieredSystem.h"
+#include "server.h"
+#include "selfCheck.h"
+
+/* Most threads a threaded replay may use. */
+#define MAX_THREADS 256
+
+/**
+ * Settings given on the command line, applied to every MemorySystem the driver creates.
+ */
+typedef struct options {
+    int policy;
+    int backend;
+    int compactMode;
+    long compactStep;
+    int policySet;
+    int threads;
+    Sweep* sweep;
+    const char* restorePath;
+    const char* savePath;
+    int exportFormat;
+    long exportFrom;
+    long exportTo;
+    const char* dumpPath;
+    const char* logPath;
+    long sampleEvery;
+    long batchSize;
+    int batchSorted;
+    TieredSystem* tiers;
+    const char* serverPath;
+    long systemSize;
+    long blockSize;
+    int selfCheck;
+} Options;
+
+/**
+ * The share of a trace one thread replays against a ShardedSystem, and what came of it.
+ * ops holds the indices of the trace operations given to the thread, in trace order.
+ */
+typedef struct replayWorker {
+    pthread_t thread;
+    ShardedSystem* system;
+    Trace* trace;
+    int homeShard;
+    long* ops;
+    long count;
+    long added;
+    long addFailed;
+    long addDuplicate;
+    long deleted;
+    long deleteFailed;
+} ReplayWorker;
 
 void startUp(long *sizePointer, long *blockPointer);
-void getInput(BlockTable* table, Directory* directory);
-void addFile(BlockTable* table, Directory* directory);
-int checkForSpace(BlockTable* bTable, int fileSize);
-void printSystem(BlockTable* table, Directory* directory);
-void deleteFile(BlockTable* table, Directory* directory);
-int main() {
+void getInput(MemorySystem* system, Options* options);
+void printState(MemorySystem* system, Options* options);
+int dumpSystem(MemorySystem* system, Options* options);
+int parseRange(const char* text, Options* options);
+int parseDevice(const char* text, Options* options);
+void addFile(MemorySystem* system);
+void deleteFile(MemorySystem* system);
+int configureSystem(MemorySystem* system, Options* options);
+int setUpSystem(MemorySystem* system, long systemSize, long blockSize, Options* options);
+void saveSystem(MemorySystem* system);
+void resizeDevice(MemorySystem* system);
+int replayTrace(const char* path, Options* options);
+int runWorkload(const char* spec, const char* outputPath, Options* options);
+int runTrace(Trace* trace, const char* source, Options* options);
+int runTraceInMode(Trace* trace, const char* source, Options* options);
+int runThreadedTrace(Trace* trace, const char* source, Options* options);
+int runTieredTrace(Trace* trace, const char* source, Options* options);
+double replayWithThreads(Trace* trace, Options* options, int threads, ShardedSystem* system, ReplayWorker* total);
+void* replayShare(void* argument);
+void printCompaction(MemorySystem* system);
+void printUsage(const char* program);
+int checkOptions(const char* given, long traceFiles);
+int main(int argc, char** argv) {
+    int option;
+    char* endPointer;
+    char* workloadSpec = NULL;
+    char* outputPath = NULL;
+    char* sweepSpec = NULL;
+    Sweep sweep = createSweep();
+    TieredSystem tiers;
+    Options options;
+    options.policy = POLICY_FIRST_FIT;
+    options.backend = TABLE_BLOCKS;
+    options.compactMode = COMPACT_OFF;
+    options.compactStep = 0;
+    options.policySet = 0;
+    options.threads = 0;
+    options.sweep = NULL;
+    options.restorePath = NULL;
+    options.savePath = NULL;
+    options.exportFormat = -1;
+    options.exportFrom = 0;
+    options.exportTo = -1;
+    options.dumpPath = NULL;
+    options.logPath = NULL;
+    options.sampleEvery = 1000;
+    options.batchSize = 0;
+    options.batchSorted = 0;
+    options.tiers = NULL;
+    options.serverPath = NULL;
+    options.systemSize = 0;
+    options.selfCheck = 0;
+    options.blockSize = 0;
+
+    while ((option = getopt(argc, argv, "p:b:c:g:o:t:s:r:w:e:x:d:l:i:a:z:u:m:k")) != -1) {
+        switch (option) {
+            case 'p':
+                options.policy = parsePolicy(optarg);
+                if (options.policy < 0) {
+                    printf("Unknown placement policy: %s\n", optarg);
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                options.policySet = 1;
+                break;
+            case 'b':
+                options.backend = parseBackend(optarg);
+                if (options.backend < 0) {
+                    printf("Unknown block table backend: %s\n", optarg);
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c':
+                if (strcmp(optarg, "full") == 0) {
+                    options.compactMode = COMPACT_FULL;
+                } else {
+                    options.compactMode = COMPACT_INCREMENTAL;
+                    errno = 0;
+                    options.compactStep = strtol(optarg, &endPointer, 10);
+                    if (*endPointer != '\0' || options.compactStep <= 0 || errno == ERANGE) {
+                        printf("Invalid compaction mode: %s\n", optarg);
+                        printUsage(argv[0]);
+                        return 1;
+                    }
+                }
+                break;
+            case 'g':
+                workloadSpec = optarg;
+                break;
+            case 'o':
+                outputPath = optarg;
+                break;
+            case 't':
+                errno = 0;
+                long threads = strtol(optarg, &endPointer, 10);
+                if (*endPointer != '\0' || threads <= 0 || threads > MAX_THREADS || errno == ERANGE) {
+                    printf("Thread count must be between 1 and %d: %s\n", MAX_THREADS, optarg);
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                options.threads = (int) threads;
+                break;
+            case 's':
+                sweepSpec = optarg;
+                break;
+            case 'r':
+                options.restorePath = optarg;
+                break;
+            case 'w':
+                options.savePath = optarg;
+                break;
+            case 'e':
+                options.exportFormat = parseExportFormat(optarg);
+                if (options.exportFormat < 0) {
+                    printf("Unknown export format: %s\n", optarg);
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'x':
+                if (parseRange(optarg, &options) != 0) {
+                    printf("Invalid block range: %s\n", optarg);
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'd':
+                options.dumpPath = optarg;
+                break;
+            case 'l':
+                options.logPath = optarg;
+                break;
+            case 'i':
+                errno = 0;
+                options.sampleEvery = strtol(optarg, &endPointer, 10);
+                if (*endPointer != '\0' || options.sampleEvery <= 0 || errno == ERANGE) {
+                    printf("Invalid sample interval: %s\n", optarg);
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'a':
+                errno = 0;
+                options.batchSize = strtol(optarg, &endPointer, 10);
+                options.batchSorted = strcmp(endPointer, "s") == 0;
+                if ((*endPointer != '\0' && !options.batchSorted) || options.batchSize <= 0 || errno == ERANGE) {
+                    printf("Invalid batch size: %s\n", optarg);
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'z':
+                if (parseTiers(&tiers, optarg) != 0) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                options.tiers = &tiers;
+                break;
+            case 'u':
+                options.serverPath = optarg;
+                break;
+            case 'k':
+                options.selfCheck = 1;
+                break;
+            case 'm':
+                if (parseDevice(optarg, &options) != 0) {
+                    printf("Invalid device size: %s\n", optarg);
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    // The options that choose or change the mode, by letter, to check they go together.
+    char given[16];
+    int givenCount = 0, i;
+    const char* letters = "gosturwdlazmk";
+    const int set[] = {workloadSpec != NULL, outputPath != NULL, sweepSpec != NULL, options.threads > 0,
+                       options.serverPath != NULL, options.restorePath != NULL, options.savePath != NULL,
+                       options.dumpPath != NULL, options.logPath != NULL, options.batchSize > 0, options.tiers != NULL,
+                       options.systemSize > 0, options.selfCheck};
+    for (i = 0; letters[i] != '\0'; i++) {
+        if (set[i]) {
+            given[givenCount++] = letters[i];
+        }
+    }
+    given[givenCount] = '\0';
+    if (checkOptions(given, argc - optind) != 0) {
+        printUsage(argv[0]);
+        return 1;
+    } else if (sweepSpec != NULL) {  // Settings not listed in the sweep come from the other options.
+        if (parseSweep(&sweep, sweepSpec) != 0) {
+            return 1;
+        }
+        if (sweep.policyCount == 0) {
+            sweep.policies[sweep.policyCount++] = options.policy;
+        }
+        sweep.backend = options.backend;
+        sweep.compactMode = options.compactMode;
+        sweep.compactStep = options.compactStep;
+        if (options.threads > 0) {
+            sweep.workers = options.threads;
+        }
+        options.sweep = &sweep;
+    }
+
+    if (workloadSpec != NULL) {  // Generate the operations instead of reading them.
+        return runWorkload(workloadSpec, outputPath, &options) == 0 ? 0 : 1;
+    } else if (argc - optind == 1) {  // A trace file was given, replay it without prompting.
+        return replayTrace(argv[optind], &options) == 0 ? 0 : 1;
+    }
 
     long* systemSizePtr = malloc(sizeof(long));
     long* blockSizePtr = malloc(sizeof(long));
     *systemSizePtr = 0;
     *blockSizePtr = 0;
-    startUp(systemSizePtr, blockSizePtr);  // Get size values for the system from the user.
+    if (options.systemSize > 0) {
+        *systemSizePtr = options.systemSize;
+        *blockSizePtr = options.blockSize;
+    } else if (options.restorePath == NULL) {
+        startUp(systemSizePtr, blockSizePtr);  // Get size values for the system from the user.
+    }
+
+    MemorySystem system;
+    int setUpResult = setUpSystem(&system, *systemSizePtr, *blockSizePtr, &options);
+    free(systemSizePtr);
+    free(blockSizePtr);
+    if (setUpResult != 0) {
+        return 1;
+    }
 
-    BlockTable sysTable = createBlockTable(*blockSizePtr, (*systemSizePtr / *blockSizePtr));
-    Directory sysDirectory = createDirectory(*systemSizePtr / *blockSizePtr);
+    if (options.serverPath != NULL) {  // Serve the system instead of prompting, then keep what -w and -d ask for.
+        int result = runServer(&system, options.serverPath);
+        if (result == 0 && options.dumpPath != NULL) {
+            result = dumpSystem(&system, &options);
+        }
+        if (result == 0 && options.savePath != NULL) {
+            result = saveSnapshot(&system, options.savePath);
+            if (result == 0) {
+                printf("Saved snapshot to %s\n", options.savePath);
+            }
+        }
+        destroyMemorySystem(&system);
+        return result == 0 ? 0 : 1;
+    }
 
     // Loop until the user enters the command to stop. Terminates the program inside the function.
     int loopFlag = 1;
     while (loopFlag > 0) {
-        getInput(&sysTable, &sysDirectory);
+        getInput(&system, &options);
+        stepCompaction(&system);
     }
 
     return 0;
 }
 
+/**
+ * Prints the command line options of the program.
+ *
+ * @param program Name the program was run as.
+ */
+void printUsage(const char* program) {
+    printf("Usage: %s [-p first|next|best|worst|buddy|scan] [-b blocks|extents] [-c full|<blocks>] [-t <threads>] [-s <sweep>] [-r <snapshot>] [-w <snapshot>] [-e rle|csv|json] [-x <first>-<last>] [-d <file>] [-l <file> [-i <count>]] [-a <count>[s]] [-z <classes>] [-m <size>/<block>] [-k] [trace file | -g <workload> [-o <file>] | -u <socket>]\n", program);
+}
+
+/* Pairs of options that cannot be given together. */
+static const char* conflictingOptions[] = {"ug", "ut", "us", "ua", "uz", "mg", "mr", "so", "tr", "tw", "td", "tl",
+                                           "ta", "sr", "sw", "sd", "sl", "sa", "zt", "zs", "zr", "zw", "zd", "zl",
+                                           "za", "wo", "do", "kt", "ks", "kz", "ku", "kr", "kw", "kd", "kl", "ka"};
+
+/**
+ * Checks that the mode options given on the command line go together, printing every pair that
+ * does not and every option missing what it needs.
+ *
+ * @param given The letters of the mode options given, for example "gw" for -g and -w.
+ * @param traceFiles Number of trace files given.
+ * @return 0 if the options can be used together, -1 otherwise.
+ */
+int checkOptions(const char* given, long traceFiles) {
+    int batchMode = traceFiles > 0 || strchr(given, 'g') != NULL;
+    int valid = 1;
+    const char* option;
+    unsigned long i;
+
+    if (traceFiles > 1) {
+        printf("Only one trace file may be given.\n");
+        valid = 0;
+    }
+    for (option = "gum"; *option != '\0'; option++) {
+        if (traceFiles > 0 && strchr(given, *option) != NULL) {
+            printf("-%c cannot be combined with a trace file.\n", *option);
+            valid = 0;
+        }
+    }
+    for (i = 0; i < sizeof(conflictingOptions) / sizeof(conflictingOptions[0]); i++) {
+        if (strchr(given, conflictingOptions[i][0]) != NULL && strchr(given, conflictingOptions[i][1]) != NULL) {
+            printf("-%c cannot be combined with -%c.\n", conflictingOptions[i][0], conflictingOptions[i][1]);
+            valid = 0;
+        }
+    }
+    if (strchr(given, 'o') != NULL && strchr(given, 'g') == NULL) {
+        printf("-o can only be used with -g.\n");
+        valid = 0;
+    }
+    for (option = "tszk"; *option != '\0'; option++) {
+        if (!batchMode && strchr(given, *option) != NULL) {
+            printf("-%c needs a trace file or -g.\n", *option);
+            valid = 0;
+        }
+    }
+    for (option = "wd"; *option != '\0'; option++) {
+        if (!batchMode && strchr(given, 'u') == NULL && strchr(given, *option) != NULL) {
+            printf("-%c needs a trace file, -g or -u.\n", *option);
+            valid = 0;
+        }
+    }
+    return valid ? 0 : -1;
+}
+
+/**
+ * Applies the command line settings that are not part of createMemorySystem() to a new system.
+ *
+ * @param system The MemorySystem being configured.
+ * @param options The settings from the command line.
+ * @return 0 if every setting was applied, -1 if the combination of settings is not supported.
+ */
+int configureSystem(MemorySystem* system, Options* options) {
+    if (setCompaction(system, options->compactMode, options->compactStep) != 0) {
+        printf("Compaction cannot be used with buddy placement.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Creates the system a run starts from, either empty or restored from the snapshot given with -r,
+ * and applies the remaining command line settings to it.
+ *
+ * @param system Receives the new MemorySystem.
+ * @param systemSize Total size of the storage device, ignored when restoring a snapshot.
+ * @param blockSize Size of each block on the storage device, ignored when restoring a snapshot.
+ * @param options The settings from the command line.
+ * @return 0 if the system was created and configured, -1 otherwise, in which case nothing is left to destroy.
+ */
+int setUpSystem(MemorySystem* system, long systemSize, long blockSize, Options* options) {
+    struct timespec begin, end;
+    if (options->restorePath == NULL) {
+        *system = createMemorySystem(systemSize, blockSize, options->policy, options->backend);
+    } else {
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        if (loadSnapshot(system, options->restorePath, options->policySet ? options->policy : -1, options->backend) != 0) {
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Restored %ld files from %s in %.3f seconds\n", system->directory.size, options->restorePath,
+               (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9);
+    }
+    if (configureSystem(system, options) != 0
+        || (options->logPath != NULL && openSystemLog(system, options->logPath, options->sampleEvery) != 0)) {
+        destroyMemorySystem(system);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Prompts the user for a path, then saves the system to it as a snapshot.
+ *
+ * @param system The MemorySystem to be saved.
+ */
+void saveSystem(MemorySystem* system) {
+    char path[256];
+    printf("Saving - enter the snapshot file path: ");
+    scanf("%255s", path);
+    if (saveSnapshot(system, path) == 0) {
+        printf("Saved %ld files to %s.\n\n", system->directory.size, path);
+    }
+}
+
+/**
+ * Prompts the user for a new storage size, then grows or shrinks the system to it.
+ *
+ * @param system The MemorySystem to be resized.
+ */
+void resizeDevice(MemorySystem* system) {
+    char sizeInput[32];
+    char* endPointer;
+    printf("Resizing - the system holds %ld bytes, enter the new size: ", system->table.length * system->table.blockSize);
+    scanf("%31s", sizeInput);
+    errno = 0;
+    long systemSize = strtol(sizeInput, &endPointer, 10);
+    if (*endPointer != '\0' || errno == ERANGE) {
+        printf("\nInvalid storage size.\n\n");
+    } else if (resizeSystem(system, systemSize) == 0) {
+        printf("The system now holds %ld blocks.\n\n", system->table.length);
+    }
+}
+
 /**
  * Prompts the user to enter the size for both the total memory of the system
  * and the size for each block within the system.
@@ -57,8 +561,12 @@ void startUp(long *sizePointer, long *blockPointer) {
     // Input validation for the size of the system memory.
     while (*sizePointer == 0 || *sizePointer < 0) {
         printf("Enter the size of your storage device: ");
-        scanf("%s", sizeInput);
+        scanf("%31s", sizeInput);
+        errno = 0;
         *sizePointer = strtol(sizeInput, &endPointer, 10);
+        if (errno == ERANGE) {  // Too large for a long, strtol clamped it.
+            *sizePointer = 0;
+        }
         if (*sizePointer == 0 || *sizePointer < 0) {
             printf("Invalid input, please try again.");
         }
@@ -69,11 +577,10 @@ void startUp(long *sizePointer, long *blockPointer) {
         char* blockInput = malloc(sizeof(char) * 32);
         *blockPointer = 0;
         printf("Enter the size of each block: ");
-        scanf("%s", blockInput);
+        scanf("%31s", blockInput);
+        errno = 0;
         *blockPointer = strtol(blockInput, &endPointer, 10);
-        long blockVal = *blockPointer;
-        long sizeVal = *sizePointer;
-        if (*blockPointer == 0 || *blockPointer < 0) {
+        if (*blockPointer == 0 || *blockPointer < 0 || errno == ERANGE) {
             printf("Invalid input, please try again.\n");
             *blockPointer = -1;
         }
@@ -86,31 +593,126 @@ void startUp(long *sizePointer, long *blockPointer) {
             printf("Invalid size: Sum of all blocks must equal system size.\n");
             printf("Please enter a block size that the system size is perfectly divisible by.\n");
             *blockPointer = -1;
+        }
+        else if (checkSystemSize(*sizePointer, *blockPointer) != 0) {  // Too many blocks, or blocks too large.
+            printf("Please enter a different block size.\n");
+            *blockPointer = -1;
         }
          free(blockInput);
     }
 
 }
 
+/**
+ * Parses a block range given as first-last, both inclusive, into the export range of the options.
+ *
+ * @param text The range to be parsed.
+ * @param options Receives the range.
+ * @return 0 if the range was valid, -1 otherwise.
+ */
+int parseRange(const char* text, Options* options) {
+    char* endPointer;
+    errno = 0;
+    long first = strtol(text, &endPointer, 10);
+    if (*endPointer != '-' || endPointer == text) {
+        return -1;
+    }
+    long last = strtol(endPointer + 1, &endPointer, 10);
+    if (*endPointer != '\0' || errno == ERANGE || first < 0 || last < first || last == LONG_MAX) {
+        return -1;
+    }
+    options->exportFrom = first;
+    options->exportTo = last + 1;
+    return 0;
+}
+
+/**
+ * Parses a device given as size/block, both of which may end in K, M or G like the sizes of a
+ * sweep, into the storage and block size of the options.
+ *
+ * @param text The device to be parsed.
+ * @param options Receives the sizes.
+ * @return 0 if the sizes were valid and fit together, -1 otherwise.
+ */
+int parseDevice(const char* text, Options* options) {
+    char size[32];
+    const char* separator = strchr(text, '/');
+    if (separator == NULL || separator - text >= (long) sizeof(size)) {
+        return -1;
+    }
+    memcpy(size, text, separator - text);
+    size[separator - text] = '\0';
+    long systemSize = parseSize(size);
+    long blockSize = parseSize(separator + 1);
+    if (systemSize < 0 || blockSize < 0 || checkSystemSize(systemSize, blockSize) != 0) {
+        return -1;
+    }
+    options->systemSize = systemSize;
+    options->blockSize = blockSize;
+    return 0;
+}
+
+/**
+ * Prints the state of the system, either with printSystem() or, if an export format was chosen,
+ * as runs of blocks in that format, limited to the chosen block range.
+ *
+ * @param system The MemorySystem to be printed.
+ * @param options The settings from the command line.
+ */
+void printState(MemorySystem* system, Options* options) {
+    if (options->exportFormat < 0) {
+        printSystem(system);
+        return;
+    }
+    fflush(stdout);
+    exportSystem(system, stdout, options->exportFormat, options->exportFrom, options->exportTo);
+}
+
+/**
+ * Exports the state of the system to the file given with -d, in the chosen format and block range.
+ *
+ * @param system The MemorySystem to be exported.
+ * @param options The settings from the command line.
+ * @return 0 if the file was written, -1 otherwise.
+ */
+int dumpSystem(MemorySystem* system, Options* options) {
+    FILE* file = fopen(options->dumpPath, "w");
+    if (file == NULL) {
+        printf("Could not open export file: %s\n", options->dumpPath);
+        return -1;
+    }
+    int format = options->exportFormat < 0 ? EXPORT_RLE : options->exportFormat;
+    int result = exportSystem(system, file, format, options->exportFrom, options->exportTo);
+    if (fclose(file) != 0 || result != 0) {
+        printf("Could not write export file: %s\n", options->dumpPath);
+        return -1;
+    }
+    printf("Exported %s to %s\n", exportFormatName(format), options->dumpPath);
+    return 0;
+}
+
 /**
  * Gives the user a selection of actions to choose from, parses and validates their input, then
  * executes the command indicated by a valid input option.
  */
-void getInput(BlockTable* bTable, Directory* directory) {
+void getInput(MemorySystem* system, Options* options) {
     char userInput[10];
     long inputValue = 0;
     char *endPointer;
 
     // Input validation.
-    while (inputValue < 1 || inputValue > 4) {
+    while (inputValue < 1 || inputValue > 7) {
         printf("Would you like to: \n");
         printf("Add a file? Enter 1\n");
         printf("Delete a file? Enter 2\n");
         printf("Print values? Enter 3\n");
         printf("Quit? Enter 4\n");
-        scanf("%s", userInput);
+        printf("Print summary? Enter 5\n");
+        printf("Save snapshot? Enter 6\n");
+        printf("Resize system? Enter 7\n");
+        scanf("%9s", userInput);
         inputValue = strtol(userInput, &endPointer, 10);
-        if (inputValue < 1 || inputValue > 4) {
+        if (inputValue < 1 || inputValue > 7) {
             printf("Invalid selection, please try again.");
         }
     }
@@ -118,146 +720,543 @@ void getInput(BlockTable* bTable, Directory* directory) {
     // Launch the command corresponding to the user input.
     switch (inputValue) {
         case 1:
-            addFile(bTable, directory);
+            addFile(system);
             break;
         case 2:
-            deleteFile(bTable, directory);
+            deleteFile(system);
             break;
         case 3: // Print the contents of memory.
-            printSystem(bTable, directory);
+            printState(system, options);
             break;
         case 4:
             printf("Exiting...");
-            destroyDirectory(directory);
-            destroyBlockTable(bTable);
+            destroyMemorySystem(system);
             exit(0);
+        case 5: // Print the utilization and fragmentation summary.
+            printf("-------------------------------------------\n");
+            printSystemSummary(system);
+            printf("-------------------------------------------\n\n");
+            break;
+        case 6:
+            saveSystem(system);
+            break;
+        case 7:
+            resizeDevice(system);
+            break;
         default:
             printf("Something has gone wrong. Exiting...");
-            destroyDirectory(directory);
-            destroyBlockTable(bTable);
+            destroyMemorySystem(system);
             exit(1);
     }
 
 }
 
 
-void addFile(BlockTable* table, Directory* directory) {
-    char fileName[64];
+/**
+ * Prompts the user for the name and size of a new file, then adds it to the system.
+ *
+ * @param system The MemorySystem the file is added to.
+ */
+void addFile(MemorySystem* system) {
+    char fileName[MAX_FILE_NAME];
     long fileSize = 0;
     char fileSizeInput[32];
     char* endPointer;
-    int newFileIndex;
     // Start prompt for user input.
     printf("Adding - enter file name: ");
-    scanf("%s", fileName);
+    scanf("%63s", fileName);
     while (fileSize <= 0) {  // Input validation for file size.
         printf("\nAdding - enter file size: ");
-        scanf("%s", fileSizeInput);
+        scanf("%31s", fileSizeInput);
+        errno = 0;
         fileSize = strtol(fileSizeInput, &endPointer, 10);
+        if (errno == ERANGE) {  // Too large for a long, strtol clamped it.
+            fileSize = 0;
+        }
         if (fileSize <= 0) {
             printf("\nInvalid file size.");
         }
     }
     // Received values from user, add file to the system.
-    newFileIndex = checkForSpace(table, fileSize);
-    if (newFileIndex < 0) {  // Not enough space for the new file.
-        printf("Not enough memory to add this file.\n\n");
-    } else {  // There is enough space, add the file to the system.
-        int blocksNeeded;
-        if (fileSize % table->blockSize != 0) {
-            blocksNeeded = (fileSize / table->blockSize) + 1;
-        } else {
-            blocksNeeded = (fileSize / table->blockSize);
-        }
-        Entry newEntry = createEntry(fileName, fileSize, newFileIndex, blocksNeeded);
-        updateTable(table, newFileIndex, fileSize);
-        addToDirectory(directory, newEntry);
-        printf("File added.\n\n");
+    switch (addFileToSystem(system, fileName, fileSize)) {
+        case SYSTEM_NO_SPACE:
+            printf("Not enough memory to add this file.\n\n");
+            break;
+        case SYSTEM_DUPLICATE:
+            printf("A file with that name already exists.\n\n");
+            break;
+        case SYSTEM_BAD_NAME:
+            printf("File names must be shorter than %d characters.\n\n", MAX_FILE_NAME);
+            break;
+        default:
+            printf("File added.\n\n");
     }
 
 }
 
 
 /**
- * Helper method for addFile. Checks the contents of the BlockTable to see if there is enough
- * contiguous memory available to add the new file. Will return the index of the first open block
- * with enough space to store the entire file if possible, if there is not enough space in memory
- * for the new file it will return -1.
+ * Prompts the user for the name of a file, then deletes it from the system.
  *
- * @param bTable The BlockTable to be checked for available space.
- * @param fileSize The size of the file attempting to be added.
- * @return The index of where the file should be stored if space is available, or -1 if there is none available.
+ * @param system The MemorySystem the file is deleted from.
  */
-int checkForSpace(BlockTable* bTable, int fileSize) {
-    int i, result, blockSize, newFileIndex, blocksNeeded, blockCounter, foundSpaceFlag;
-    blockSize = bTable->blockSize;
-
-    // Determine how many blocks of memory the new file will need.
-    if (fileSize <= blockSize) {
-        blocksNeeded = 1;
-    } else if (fileSize % blockSize == 0) {
-        blocksNeeded = fileSize / blockSize;
+void deleteFile(MemorySystem* system) {
+    char fileName[MAX_FILE_NAME];
+    printf("Deleting - Enter the file name: ");
+    scanf("%63s", fileName);
+    if (deleteFileFromSystem(system, fileName) == SYSTEM_OK) {
+        printf("File successfully deleted.\n\n");
     } else {
-        blocksNeeded = (fileSize / blockSize) + 1;
-    }
-
-    // Iterate through the table and see if there is contiguous space for the new file.
-    // If available space is available for the file, find the index of the first block where
-    // we can store it.
-    blockCounter = 0;
-    foundSpaceFlag = 0;
-    newFileIndex = -1;
-    for (i = 0; i < bTable->length; i++) {
-        if ( (bTable->table + (sizeof(Block) * i))->inUse == 0 ) {    // Blocks have member field 'inUse' with arithmetic boolean values.
-            blockCounter++;
-            if (blockCounter == blocksNeeded) {  // Branch here if we found enough space for the file.
-                newFileIndex = (i + 1) - blocksNeeded;
-                foundSpaceFlag = 1;  // Set flag to binary true.
+        printf("No such file was found in the system.\n");
+    }
+
+}
+
+
+/**
+ * Replays every operation of a trace file against a new system without prompting, then
+ * prints a summary of the run. Print operations in the trace still print the system state.
+ *
+ * @param path Path of the trace file.
+ * @param options The settings from the command line.
+ * @return 0 if the trace was replayed, -1 if it could not be read.
+ */
+int replayTrace(const char* path, Options* options) {
+    Trace trace;
+    if (loadTrace(&trace, path) != 0) {
+        return -1;
+    }
+    int result = runTraceInMode(&trace, path, options);
+    destroyTrace(&trace);
+    return result;
+}
+
+/**
+ * Generates a synthetic workload, then either replays it like a trace file or writes it out
+ * as one. The settings are written as a comment at the top of the file so it can be recreated.
+ *
+ * @param spec The workload settings, see workload.c.
+ * @param outputPath Path to write the trace to, or NULL to replay the workload instead.
+ * @param options The settings from the command line.
+ * @return 0 if the workload was replayed or written, -1 otherwise.
+ */
+int runWorkload(const char* spec, const char* outputPath, Options* options) {
+    Workload workload = createWorkload();
+    Trace trace;
+    char description[512];
+    int result;
+
+    if (parseWorkload(&workload, spec) != 0) {
+        return -1;
+    }
+    generateWorkload(&workload, &trace);
+    formatWorkload(&workload, description, sizeof(description));
+
+    if (outputPath != NULL) {
+        result = writeTrace(&trace, outputPath, description);
+        if (result == 0) {
+            printf("Wrote %ld operations to %s\n", trace.count, outputPath);
+        }
+    } else {
+        printf("Workload:\t\t%s\n", description);
+        result = runTraceInMode(&trace, "generated workload", options);
+    }
+    destroyTrace(&trace);
+    return result;
+}
+
+/**
+ * Replays a Trace the way the command line asks for: as a sweep over many configurations, with
+ * several threads against a sharded system, once against a device split into size classes, as a
+ * self-check of the backends and snapshots, or once against a single system.
+ *
+ * @param trace The operations to be replayed.
+ * @param source Where the operations came from, for the summary.
+ * @param options The settings from the command line.
+ * @return 0 if the trace was replayed, -1 otherwise.
+ */
+int runTraceInMode(Trace* trace, const char* source, Options* options) {
+    if (options->sweep != NULL) {
+        printf("Sweeping %s\n", source);
+        return runSweep(options->sweep, trace);
+    } else if (options->threads > 0) {
+        return runThreadedTrace(trace, source, options);
+    } else if (options->tiers != NULL) {
+        return runTieredTrace(trace, source, options);
+    } else if (options->selfCheck) {
+        printf("Checking %s\n", source);
+        return runSelfCheck(trace, options->policySet ? options->policy : -1, options->compactMode, options->compactStep);
+    }
+    return runTrace(trace, source, options);
+}
+
+/**
+ * Replays every operation of a Trace against a new system, then prints a summary of the run.
+ *
+ * @param trace The operations to be replayed.
+ * @param source Where the operations came from, for the summary.
+ * @param options The settings from the command line.
+ * @return 0 if the trace was replayed, -1 if the system could not be created or configured.
+ */
+int runTrace(Trace* trace, const char* source, Options* options) {
+    struct timespec begin, end;
+    long i, j, added = 0, addFailed = 0, addDuplicate = 0, deleted = 0, deleteFailed = 0, resized = 0, resizeFailed = 0;
+
+    MemorySystem system;
+    if (options->restorePath == NULL && checkSystemSize(trace->systemSize, trace->blockSize) != 0) {
+        return -1;
+    } else if (setUpSystem(&system, trace->systemSize, trace->blockSize, options) != 0) {
+        return -1;
+    }
+
+    BatchRequest* batch = options->batchSize > 0 ? malloc(sizeof(BatchRequest) * options->batchSize) : NULL;
+    resetScanStats();
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (i = 0; i < trace->count; i++) {
+        Operation* op = trace->ops + i;
+        switch (op->type) {
+            case OP_ADD:
+                if (batch != NULL) {  // Take this add and the ones right after it as one batch.
+                    long count = 0;
+                    for (; count < options->batchSize && i + count < trace->count && op[count].type == OP_ADD; count++) {
+                        batch[count].fileName = operationName(trace, op + count);
+                        batch[count].size = op[count].size;
+                    }
+                    added += addFilesToSystem(&system, batch, count, options->batchSorted);
+                    for (j = 0; j < count; j++) {
+                        addFailed += batch[j].result == SYSTEM_NO_SPACE;
+                        addDuplicate += batch[j].result == SYSTEM_DUPLICATE;
+                    }
+                    i += count - 1;
+                    break;
+                }
+                switch (addFileToSystem(&system, operationName(trace, op), op->size)) {
+                    case SYSTEM_OK:
+                        added++;
+                        break;
+                    case SYSTEM_DUPLICATE:
+                        addDuplicate++;
+                        break;
+                    default:
+                        addFailed++;
+                }
+                break;
+            case OP_DELETE:
+                if (deleteFileFromSystem(&system, operationName(trace, op)) == SYSTEM_OK) {
+                    deleted++;
+                } else {
+                    deleteFailed++;
+                }
+                break;
+            case OP_PRINT:
+                printState(&system, options);
+                break;
+            case OP_SUMMARY:
+                printSystemSummary(&system);
+                break;
+            case OP_RESIZE:
+                if (resizeSystem(&system, op->size) == 0) {
+                    resized++;
+                } else {
+                    resizeFailed++;
+                }
                 break;
-            }
-        } else {    // Branch here if the block checked was already in use, reset the counter and continue search.
-            blockCounter = 0;
         }
+        stepCompaction(&system);
     }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+    free(batch);
 
-    // If we found contiguous memory, return index of first open space. If not, return -1.
-    if (foundSpaceFlag == 1) {
-        result = newFileIndex;
-    } else {
-        result = -1;
+    printf("Replayed %ld operations from %s in %.3f seconds", trace->count, source, seconds);
+    if (seconds > 0) {
+        printf(" (%.0f ops/sec)", trace->count / seconds);
+    }
+    printf("\n");
+    printf("Placement policy:\t%s\n", policyName(system.placement.policy));
+    printf("Block table:\t\t%s\n", backendName(options->backend));
+    if (options->batchSize > 0) {
+        printf("Batched adds:\t\tup to %ld%s\n", options->batchSize, options->batchSorted ? ", largest first" : "");
+    }
+    printf("Files added:\t\t%ld\n", added);
+    printf("Adds failed (no space):\t%ld\n", addFailed);
+    printf("Adds failed (duplicate):\t%ld\n", addDuplicate);
+    printf("Files deleted:\t\t%ld\n", deleted);
+    printf("Deletes failed (missing):\t%ld\n", deleteFailed);
+    if (resized + resizeFailed > 0) {
+        printf("Resizes:\t\t%ld (%ld refused)\n", resized, resizeFailed);
+    }
+    printSystemSummary(&system);
+    printCompaction(&system);
+#ifdef SCAN_STATS
+    printScanStats();
+#endif
+    if (system.log != NULL) {
+        printf("Event log:\t\t%ld records, %ld waits for the writer\n", system.log->head, system.log->stalls);
     }
 
+    int result = 0;
+    if (options->dumpPath != NULL) {
+        result = dumpSystem(&system, options);
+    }
+    if (result == 0 && options->savePath != NULL) {
+        result = saveSnapshot(&system, options->savePath);
+        if (result == 0) {
+            printf("Saved snapshot to %s\n", options->savePath);
+        }
+    }
+    destroyMemorySystem(&system);
     return result;
 }
 
-void deleteFile(BlockTable* table, Directory* directory) {
-    char fileName[64];
-    printf("Deleting - Enter the file name: ");
-    scanf("%s", fileName);
-    int blockLength, blockStart, i;
-    int fileIndex = findEntryInDirectory(directory, fileName);
-    if (fileIndex >= 0) {  // Branch here if an Entry matching the fileName was found.
-        blockLength = (directory->list + (sizeof(Entry) * fileIndex))->length;
-        blockStart = (directory->list + (sizeof(Entry) * fileIndex))->start;
-        // Iterate over and reset BlockTable elements belonging to the deleted file.
-        for (i = 0; i < blockLength; i++) {
-            resetBlock((table->table + (sizeof(Block) * (i + blockStart))));
+/**
+ * Prints how much work compaction has done, if it is turned on.
+ *
+ * @param system The MemorySystem whose compaction counters are printed.
+ */
+void printCompaction(MemorySystem* system) {
+    Compactor* c = &system->compactor;
+    if (c->mode == COMPACT_OFF) {
+        return;
+    }
+    printf("Compaction:\t\t%s", c->mode == COMPACT_FULL ? "full" : "incremental");
+    if (c->mode == COMPACT_INCREMENTAL) {
+        printf(" (%ld blocks per step)", c->stepBlocks);
+    }
+    printf("\n");
+    printf("Full passes:\t\t%ld\n", c->passes);
+    printf("Files moved:\t\t%ld\n", c->filesMoved);
+    printf("Blocks moved:\t\t%ld\n", c->blocksMoved);
+    printf("Adds rescued:\t\t%ld\n", c->rescuedAdds);
+}
+
+/**
+ * Replays the adds and deletes of a Trace against a new TieredSystem with the size classes given
+ * with -z, then prints a summary of the run and of every class.
+ *
+ * @param trace The operations to be replayed.
+ * @param source Where the operations came from, for the summary.
+ * @param options The settings from the command line.
+ * @return 0 if the trace was replayed, -1 if the system could not be created or configured.
+ */
+int runTieredTrace(Trace* trace, const char* source, Options* options) {
+    struct timespec begin, end;
+    long i, added = 0, addFailed = 0, addDuplicate = 0, deleted = 0, deleteFailed = 0;
+    int t;
+
+    TieredSystem system = *options->tiers;
+    if (createTieredSystem(&system, trace->systemSize, options->policy, options->backend) != 0) {
+        return -1;
+    }
+    for (t = 0; t < system.tierCount; t++) {
+        if (configureSystem(&system.tiers[t].system, options) != 0) {
+            destroyTieredSystem(&system);
+            return -1;
         }
+    }
 
-        // Remove the Entry from the Directory.
-        deleteFromDirectory(directory, fileIndex);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (i = 0; i < trace->count; i++) {
+        Operation* op = trace->ops + i;
+        if (op->type == OP_ADD) {
+            switch (addFileToTiers(&system, operationName(trace, op), op->size)) {
+                case SYSTEM_OK:
+                    added++;
+                    break;
+                case SYSTEM_DUPLICATE:
+                    addDuplicate++;
+                    break;
+                default:
+                    addFailed++;
+            }
+        } else if (op->type == OP_DELETE) {
+            if (deleteFileFromTiers(&system, operationName(trace, op)) == SYSTEM_OK) {
+                deleted++;
+            } else {
+                deleteFailed++;
+            }
+        }
+        for (t = 0; t < system.tierCount; t++) {
+            stepCompaction(&system.tiers[t].system);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
 
-        printf("File successfully deleted.\n\n");
-    } else {
-        printf("No such file was found in the system.\n");
+    printf("Replayed %ld operations from %s in %.3f seconds", trace->count, source, seconds);
+    if (seconds > 0) {
+        printf(" (%.0f ops/sec)", trace->count / seconds);
     }
+    printf("\n");
+    printf("Placement policy:\t%s\n", policyName(options->policy));
+    printf("Block table:\t\t%s\n", backendName(options->backend));
+    printf("Size classes:\t\t%d\n", system.tierCount);
+    printf("Files added:\t\t%ld\n", added);
+    printf("Adds failed (no space):\t%ld\n", addFailed);
+    printf("Adds failed (duplicate):\t%ld\n", addDuplicate);
+    printf("Files deleted:\t\t%ld\n", deleted);
+    printf("Deletes failed (missing):\t%ld\n", deleteFailed);
+    printTieredSummary(&system);
+    destroyTieredSystem(&system);
+    return 0;
+}
+
+/**
+ * Replays a Trace with a growing number of threads, 1, 2, 4 and so on up to the thread count
+ * from the command line, printing the throughput of each run and its speedup over one thread.
+ * Every run starts from a new ShardedSystem with one shard per thread. The outcome of the last
+ * run, and the system it left, are summarized like runTrace() does.
+ *
+ * @param trace The operations to be replayed.
+ * @param source Where the operations came from, for the summary.
+ * @param options The settings from the command line.
+ * @return 0 if the trace was replayed, -1 if the system could not be created or configured.
+ */
+int runThreadedTrace(Trace* trace, const char* source, Options* options) {
+    ShardedSystem system;
+    ReplayWorker total;
+    double baseline = 0;
+    int threads = 1;
 
+    if (checkSystemSize(trace->systemSize, trace->blockSize) != 0) {
+        return -1;
+    } else if (options->compactMode != COMPACT_OFF) {
+        printf("Compaction cannot be used with a threaded replay.\n");
+        return -1;
+    }
+
+    printf("Replaying %ld operations from %s\n", trace->count, source);
+    printf("Threads\tSeconds\t\tOps/sec\t\tSpeedup\n");
+    while (1) {
+        int last = threads >= options->threads;
+        if (last) {
+            threads = options->threads;
+        }
+        double seconds = replayWithThreads(trace, options, threads, &system, &total);
+        if (threads == 1) {
+            baseline = seconds;
+        }
+        printf("%d\t%.3f\t\t%.0f\t\t%.2f\n", threads, seconds, seconds > 0 ? trace->count / seconds : 0,
+               seconds > 0 ? baseline / seconds : 0);
+        if (last) {
+            break;
+        }
+        destroyShardedSystem(&system);
+        threads *= 2;
+    }
+
+    printf("Placement policy:\t%s\n", policyName(options->policy));
+    printf("Block table:\t\t%s\n", backendName(options->backend));
+    printf("Threads:\t\t%d\n", threads);
+    printf("Files added:\t\t%ld\n", total.added);
+    printf("Adds failed (no space):\t%ld\n", total.addFailed);
+    printf("Adds failed (duplicate):\t%ld\n", total.addDuplicate);
+    printf("Files deleted:\t\t%ld\n", total.deleted);
+    printf("Deletes failed (missing):\t%ld\n", total.deleteFailed);
+    printShardedSummary(&system);
+    destroyShardedSystem(&system);
+    return 0;
+}
+
+/**
+ * Replays a Trace once against a new ShardedSystem with the given number of threads. Operations
+ * are dealt out to the threads by the hash of their file name, so every operation on a file runs
+ * on the same thread in the order the trace gives them.
+ *
+ * @param trace The operations to be replayed.
+ * @param options The settings from the command line.
+ * @param threads Number of threads, and of shards, to replay with.
+ * @param system Receives the ShardedSystem the trace was replayed against, which the caller
+ *               destroys.
+ * @param total Receives the outcome of the replay, the counts of all threads added up.
+ * @return The wall clock time the threads took, in seconds.
+ */
+double replayWithThreads(Trace* trace, Options* options, int threads, ShardedSystem* system, ReplayWorker* total) {
+    struct timespec begin, end;
+    ReplayWorker* workers = calloc(threads, sizeof(ReplayWorker));
+    long* ops = malloc(sizeof(long) * (trace->count > 0 ? trace->count : 1));
+    int* owner = malloc(sizeof(int) * (trace->count > 0 ? trace->count : 1));
+    long i, next = 0;
+    int t;
+
+    // Count each thread's share first so every share can be one slice of ops.
+    for (i = 0; i < trace->count; i++) {
+        Operation* op = trace->ops + i;
+        owner[i] = -1;
+        if (op->type == OP_ADD || op->type == OP_DELETE) {
+            owner[i] = (int) (hashName(operationName(trace, op)) % threads);
+            workers[owner[i]].count++;
+        }
+    }
+    *system = createShardedSystem(trace->systemSize, trace->blockSize, threads, options->policy, options->backend);
+    for (t = 0; t < threads; t++) {
+        workers[t].system = system;
+        workers[t].trace = trace;
+        workers[t].homeShard = t;
+        workers[t].ops = ops + next;
+        next += workers[t].count;
+        workers[t].count = 0;
+    }
+    for (i = 0; i < trace->count; i++) {
+        if (owner[i] >= 0) {
+            ReplayWorker* w = &workers[owner[i]];
+            w->ops[w->count++] = i;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (t = 0; t < threads; t++) {
+        pthread_create(&workers[t].thread, NULL, replayShare, &workers[t]);
+    }
+    for (t = 0; t < threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+    *total = workers[0];
+    for (t = 1; t < threads; t++) {
+        total->added += workers[t].added;
+        total->addFailed += workers[t].addFailed;
+        total->addDuplicate += workers[t].addDuplicate;
+        total->deleted += workers[t].deleted;
+        total->deleteFailed += workers[t].deleteFailed;
+    }
+
+    free(owner);
+    free(ops);
+    free(workers);
+    return seconds;
 }
 
-void printSystem(BlockTable* table, Directory* directory) {
-    printf("-------------------------------------------\n");
-    printDirectory(directory);
-    printf("-------------------------------------------\n");
-    printTable(table);
-    printf("-------------------------------------------\n\n");
+/**
+ * Thread body of a threaded replay: runs one ReplayWorker's share of the trace.
+ *
+ * @param argument The ReplayWorker to be run.
+ * @return Always NULL.
+ */
+void* replayShare(void* argument) {
+    ReplayWorker* w = argument;
+    long i;
+    for (i = 0; i < w->count; i++) {
+        Operation* op = w->trace->ops + w->ops[i];
+        char* fileName = operationName(w->trace, op);
+        if (op->type == OP_ADD) {
+            switch (addFileToShards(w->system, w->homeShard, fileName, op->size)) {
+                case SYSTEM_OK:
+                    w->added++;
+                    break;
+                case SYSTEM_DUPLICATE:
+                    w->addDuplicate++;
+                    break;
+                default:
+                    w->addFailed++;
+            }
+        } else if (deleteFileFromShards(w->system, fileName) == SYSTEM_OK) {
+            w->deleted++;
+        } else {
+            w->deleteFailed++;
+        }
+    }
+    return NULL;
 }
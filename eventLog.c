@@ -0,0 +1,212 @@
+//
+// eventLog.c
+//
+// Writes a CSV file with one row per record:
+//
+//     type,operation,start,length,cost_ns,used_bytes,fragmented_bytes,blocks_in_use,free_blocks,free_extents,largest_free_extent
+//
+// type is add, delete, no_space, batch or sample. Event rows leave the metric columns empty and sample
+// rows leave start, length and cost_ns empty, so the samples can be plotted against operation.
+//
+
+#include "eventLog.h"
+#include <stdlib.h>
+
+/* Size of the stdio buffer the log file is written through. */
+#define EVENT_LOG_WRITE_BUFFER (1 << 20)
+
+
+/**
+ * Writes one record to the log file.
+ */
+static void writeRecord(FILE* out, LogRecord* r) {
+    TableMetrics* m = &r->metrics;
+    switch (r->type) {
+        case EVENT_SAMPLE:
+            fprintf(out, "sample,%ld,,,,%ld,%ld,%ld,%ld,%ld,%ld\n", r->operation, m->usedBytes,
+                    m->fragmentedBytes, m->blocksInUse, m->freeBlocks, m->freeExtents, m->largestFreeExtent);
+            break;
+        default:
+            fprintf(out, "%s,%ld,%ld,%ld,%ld,,,,,,\n",
+                    r->type == EVENT_ADD ? "add" : r->type == EVENT_DELETE ? "delete"
+                    : r->type == EVENT_BATCH ? "batch" : "no_space",
+                    r->operation, r->start, r->length, r->cost);
+    }
+}
+
+
+/**
+ * Thread body of the writer: writes out every record the ring holds, then sleeps until half the
+ * ring has filled again, EVENT_LOG_FLUSH_MS have passed, or the log is closed.
+ */
+static void* writeRecords(void* argument) {
+    EventLog* log = argument;
+    long tail = log->tail;
+    while (1) {
+        long head = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+        if (head != tail) {
+            for (; tail < head; tail++) {
+                writeRecord(log->out, &log->ring[tail & (EVENT_LOG_CAPACITY - 1)]);
+            }
+            pthread_mutex_lock(&log->lock);
+            __atomic_store_n(&log->tail, tail, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&log->space);
+            pthread_mutex_unlock(&log->lock);
+            continue;
+        }
+
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += EVENT_LOG_FLUSH_MS * 1000000L;
+        wake.tv_sec += wake.tv_nsec / 1000000000L;
+        wake.tv_nsec %= 1000000000L;
+        pthread_mutex_lock(&log->lock);
+        if (__atomic_load_n(&log->head, __ATOMIC_ACQUIRE) == tail) {
+            if (log->closing) {
+                pthread_mutex_unlock(&log->lock);
+                break;
+            }
+            fflush(log->out);  // Nothing new for now, let readers of the file see what there is.
+            pthread_cond_timedwait(&log->ready, &log->lock, &wake);
+        }
+        pthread_mutex_unlock(&log->lock);
+    }
+    return NULL;
+}
+
+
+/**
+ * Takes the next free record of the ring, waiting for the writer if the ring is full.
+ */
+static LogRecord* nextRecord(EventLog* log) {
+    long head = log->head;
+    if (head - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE) == EVENT_LOG_CAPACITY) {
+        pthread_mutex_lock(&log->lock);
+        log->stalls++;
+        pthread_cond_signal(&log->ready);
+        while (head - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE) == EVENT_LOG_CAPACITY) {
+            pthread_cond_wait(&log->space, &log->lock);
+        }
+        pthread_mutex_unlock(&log->lock);
+    }
+    return &log->ring[head & (EVENT_LOG_CAPACITY - 1)];
+}
+
+
+/**
+ * Hands the record taken by nextRecord() to the writer, waking it every time half the ring fills.
+ */
+static void publishRecord(EventLog* log) {
+    long head = log->head + 1;
+    __atomic_store_n(&log->head, head, __ATOMIC_RELEASE);
+    if ((head & (EVENT_LOG_CAPACITY / 2 - 1)) == 0) {
+        pthread_mutex_lock(&log->lock);
+        pthread_cond_signal(&log->ready);
+        pthread_mutex_unlock(&log->lock);
+    }
+}
+
+
+/**
+ * Opens a new EventLog writing to the given file, and starts its writer thread.
+ *
+ * @param log The EventLog to be opened, which must stay at the same address until it is closed.
+ * @param path Path of the CSV file, which is replaced if it exists.
+ * @param sampleEvery Number of operations between samples of the table's metrics.
+ * @return 0 if the log was opened, -1 if the file could not be created.
+ */
+int openEventLog(EventLog* log, const char* path, long sampleEvery) {
+    log->out = fopen(path, "w");
+    if (log->out == NULL) {
+        printf("Could not open event log: %s\n", path);
+        return -1;
+    }
+    setvbuf(log->out, NULL, _IOFBF, EVENT_LOG_WRITE_BUFFER);
+    fprintf(log->out, "type,operation,start,length,cost_ns,used_bytes,fragmented_bytes,blocks_in_use,"
+                      "free_blocks,free_extents,largest_free_extent\n");
+
+    log->ring = malloc(sizeof(LogRecord) * EVENT_LOG_CAPACITY);
+    log->head = 0;
+    log->tail = 0;
+    log->operations = 0;
+    log->sampleEvery = sampleEvery;
+    log->stalls = 0;
+    log->closing = 0;
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->ready, NULL);
+    pthread_cond_init(&log->space, NULL);
+    pthread_create(&log->writer, NULL, writeRecords, log);
+    return 0;
+}
+
+
+/**
+ * Writes out every record still in the ring, stops the writer thread and closes the file.
+ *
+ * @param log The EventLog to be closed.
+ */
+void closeEventLog(EventLog* log) {
+    pthread_mutex_lock(&log->lock);
+    log->closing = 1;
+    pthread_cond_signal(&log->ready);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->writer, NULL);
+
+    fclose(log->out);
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->ready);
+    pthread_cond_destroy(&log->space);
+    free(log->ring);
+    log->ring = NULL;
+}
+
+
+/**
+ * Notes the time an operation starts, which the cost of its event is measured from.
+ *
+ * @param log The EventLog the operation will be recorded in.
+ */
+void startEvent(EventLog* log) {
+    clock_gettime(CLOCK_MONOTONIC, &log->begin);
+}
+
+
+/**
+ * Records an operation, and a sample of the table's metrics if it is the operation one is due on.
+ *
+ * @param log The EventLog the operation is recorded in.
+ * @param type EVENT_ADD, EVENT_DELETE, EVENT_NO_SPACE or EVENT_BATCH.
+ * @param start First block the operation took or freed, -1 if it failed.
+ * @param length Number of blocks the operation took, freed, or needed.
+ * @param bTable The BlockTable the operation ran against.
+ */
+void logEvent(EventLog* log, char type, long start, long length, BlockTable* bTable) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    LogRecord* r = nextRecord(log);
+    r->type = type;
+    r->operation = ++log->operations;
+    r->start = start;
+    r->length = length;
+    r->cost = (end.tv_sec - log->begin.tv_sec) * 1000000000L + (end.tv_nsec - log->begin.tv_nsec);
+    publishRecord(log);
+
+    if (log->operations % log->sampleEvery == 0) {
+        logSample(log, bTable);
+    }
+}
+
+
+/**
+ * Records a sample of a table's metrics. Takes constant time, see getTableMetrics().
+ *
+ * @param log The EventLog the sample is recorded in.
+ * @param bTable The BlockTable to be sampled.
+ */
+void logSample(EventLog* log, BlockTable* bTable) {
+    LogRecord* r = nextRecord(log);
+    r->type = EVENT_SAMPLE;
+    r->operation = log->operations;
+    r->metrics = getTableMetrics(bTable);
+    publishRecord(log);
+}
@@ -0,0 +1,74 @@
+//
+// eventLog.h
+//
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "blockTable.h"
+
+typedef struct logRecord LogRecord;
+typedef struct eventLog EventLog;
+
+/* Kinds of records an EventLog holds. */
+#define EVENT_ADD 'a'
+#define EVENT_DELETE 'd'
+#define EVENT_NO_SPACE 'f'
+#define EVENT_SAMPLE 's'
+#define EVENT_BATCH 'b'
+
+/* Number of records the ring buffer of an EventLog holds, must be a power of two, and the longest
+ * a record waits to be written out. */
+#define EVENT_LOG_CAPACITY (1 << 16)
+#define EVENT_LOG_FLUSH_MS 100
+
+/**
+ * Definition of the LogRecord type. One add, delete or failed add, numbered by operation, with
+ * the blocks it took or freed (start is -1 for a failed add) and its cost in nanoseconds. A batch
+ * of adds is one record with start -1 and the total blocks the batch took. For a sample, only
+ * operation and the table's metrics at that point are set.
+ */
+struct logRecord {
+    char type;
+    long operation;
+    long start;
+    long length;
+    long cost;
+    TableMetrics metrics;
+};
+
+/**
+ * Definition of the EventLog type. Records are written into a preallocated ring buffer by the
+ * thread running the MemorySystem and written out to a CSV file by a writer thread of the log's
+ * own, so the operations only pay for filling in a record. head and tail count every record ever
+ * written and flushed, and each is only changed by one of the two threads. The writer wakes up
+ * every time half the ring has filled, and at least every EVENT_LOG_FLUSH_MS otherwise. If the
+ * ring is ever full the operation waits for the writer, which is counted in stalls. A sample of
+ * the table's metrics is logged every sampleEvery operations.
+ */
+struct eventLog {
+    LogRecord* ring;
+    long head;
+    long tail;
+    long operations;
+    long sampleEvery;
+    long stalls;
+    struct timespec begin;
+    FILE* out;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+    int closing;
+};
+
+int openEventLog(EventLog* log, const char* path, long sampleEvery);
+void closeEventLog(EventLog* log);
+void startEvent(EventLog* log);
+void logEvent(EventLog* log, char type, long start, long length, BlockTable* bTable);
+void logSample(EventLog* log, BlockTable* bTable);
+
+#endif
@@ -0,0 +1,290 @@
+//
+// export.c
+//
+// Writes the state of a MemorySystem, or of one range of its blocks, as a stream. Consecutive
+// blocks in the same state (free, or in use with the same number of bytes used) are collapsed
+// into one run, found from the free index and the Directory's extents rather than block by
+// block, so the output and the time taken grow with the number of runs, not of blocks. Every
+// file with a block in the range is listed after the runs, in block order. Three formats exist:
+//
+//     rle    Human readable columns, one row per run, then one row per file.
+//     csv    A start,length,in_use,used,fragmented table of runs, where used and fragmented are
+//            per block, then a blank line and a name,size,start,length table of files.
+//     json   One object with blockSize, blocks, from and to, and runs and files arrays holding
+//            objects with the same fields as the csv tables.
+//
+// Output is collected in a large buffer and handed to the stream in big writes.
+//
+
+#include "export.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Size of the output buffer, and the most one row may take up in it. */
+#define EXPORT_BUFFER_SIZE (1 << 20)
+#define EXPORT_MAX_ROW 1024
+
+static const char* exportFormatNames[EXPORT_FORMAT_COUNT] = {"rle", "csv", "json"};
+
+/**
+ * Output collected for one export, written to out whenever it fills up.
+ */
+typedef struct exportBuffer {
+    FILE* out;
+    char* data;
+    long used;
+} ExportBuffer;
+
+/**
+ * A run of consecutive blocks in the same state. used and fragmented are per block.
+ */
+typedef struct blockRun {
+    long start;
+    long length;
+    int inUse;
+    long used;
+    long fragmented;
+} BlockRun;
+
+
+/**
+ * Parses the name of an export format.
+ *
+ * @param name One of "rle", "csv" or "json".
+ * @return The matching EXPORT_ constant, or -1 if the name is not recognized.
+ */
+int parseExportFormat(const char* name) {
+    int i;
+    for (i = 0; i < EXPORT_FORMAT_COUNT; i++) {
+        if (strcmp(name, exportFormatNames[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * Gives the name of an export format.
+ *
+ * @param format One of the EXPORT_ constants.
+ * @return The name the format is parsed from.
+ */
+const char* exportFormatName(int format) {
+    return exportFormatNames[format];
+}
+
+
+/**
+ * Hands everything collected in the buffer to its stream.
+ */
+static void flushBuffer(ExportBuffer* buffer) {
+    fwrite(buffer->data, 1, buffer->used, buffer->out);
+    buffer->used = 0;
+}
+
+
+/**
+ * Appends printf formatted text, at most EXPORT_MAX_ROW bytes of it, to the buffer. Nothing is
+ * appended if the text cannot be formatted.
+ */
+static void emit(ExportBuffer* buffer, const char* format, ...) {
+    va_list arguments;
+    if (buffer->used > EXPORT_BUFFER_SIZE - EXPORT_MAX_ROW) {
+        flushBuffer(buffer);
+    }
+    va_start(arguments, format);
+    int written = vsnprintf(buffer->data + buffer->used, EXPORT_MAX_ROW, format, arguments);
+    va_end(arguments);
+    if (written > 0) {
+        buffer->used += written < EXPORT_MAX_ROW ? written : EXPORT_MAX_ROW - 1;
+    }
+}
+
+
+/**
+ * Appends a file name to the buffer, quoted and escaped as the format needs.
+ */
+static void emitName(ExportBuffer* buffer, const char* name, int format) {
+    char escaped[EXPORT_MAX_ROW / 2];
+    long length = 0;
+    if (format == EXPORT_RLE) {
+        emit(buffer, "%-32s", name);
+        return;
+    }
+    escaped[length++] = '"';
+    for (; *name != '\0'; name++) {  // Names are at most MAX_FILE_NAME bytes, six times that still fits.
+        unsigned char c = (unsigned char) *name;
+        if (format == EXPORT_CSV && c == '"') {
+            escaped[length++] = '"';
+            escaped[length++] = '"';
+        } else if (format == EXPORT_JSON && (c == '"' || c == '\\')) {
+            escaped[length++] = '\\';
+            escaped[length++] = (char) c;
+        } else if (format == EXPORT_JSON && c < 0x20) {
+            length += snprintf(escaped + length, 7, "\\u%04x", c);
+        } else {
+            escaped[length++] = (char) c;
+        }
+    }
+    escaped[length++] = '"';
+    escaped[length] = '\0';
+    emit(buffer, "%s", escaped);
+}
+
+
+/**
+ * Finds the run of blocks in the same state starting at block p, cut off at block to. Free runs
+ * come from the free index. In-use runs come from the Directory's extents, as every block of a
+ * file but the last is full, so whichever the table's backend the blocks are never visited.
+ */
+static void findRun(BlockTable* bTable, Directory* d, long p, long to, BlockRun* run) {
+    FreeIndex* index = &bTable->freeIndex;
+    ExtentNode* gap = findFloorExtent(&index->byStart, p);
+    long end;
+    run->start = p;
+    if (gap != NULL && p < gap->start + gap->length) {
+        end = gap->start + gap->length;
+        run->inUse = 0;
+        run->used = 0;
+        run->fragmented = 0;
+    } else {
+        ExtentNode* file = findFloorExtent(&d->extents, p);
+        long last = file->start + file->length - 1;
+        end = p < last ? last : p + 1;
+        run->inUse = 1;
+        run->used = p < last ? bTable->blockSize : d->list[file->owner].size - (file->length - 1) * bTable->blockSize;
+        run->fragmented = bTable->blockSize - run->used;
+    }
+    run->length = (end < to ? end : to) - p;
+}
+
+
+/**
+ * Appends one run of blocks to the buffer.
+ */
+static void emitRun(ExportBuffer* buffer, int format, BlockRun* run, int first) {
+    switch (format) {
+        case EXPORT_RLE: {
+            char blocks[48];
+            if (run->length == 1) {
+                snprintf(blocks, sizeof(blocks), "%ld", run->start);
+            } else {
+                snprintf(blocks, sizeof(blocks), "%ld-%ld", run->start, run->start + run->length - 1);
+            }
+            emit(buffer, "%-24s", blocks);
+            if (run->inUse) {
+                emit(buffer, "%-8s%-12ld%ld\n", "used", run->used, run->fragmented);
+            } else {
+                emit(buffer, "free\n");
+            }
+            break;
+        }
+        case EXPORT_CSV:
+            emit(buffer, "%ld,%ld,%d,%ld,%ld\n", run->start, run->length, run->inUse, run->used, run->fragmented);
+            break;
+        default:
+            emit(buffer, "%s\n    {\"start\": %ld, \"length\": %ld, \"inUse\": %s, \"used\": %ld, \"fragmented\": %ld}",
+                 first ? "" : ",", run->start, run->length, run->inUse ? "true" : "false", run->used, run->fragmented);
+    }
+}
+
+
+/**
+ * Appends one file to the buffer.
+ */
+static void emitFile(ExportBuffer* buffer, int format, Entry* e, int first) {
+    if (format == EXPORT_JSON) {
+        emit(buffer, "%s\n    {\"name\": ", first ? "" : ",");
+        emitName(buffer, e->fileName, format);
+        emit(buffer, ", \"size\": %ld, \"start\": %ld, \"length\": %ld}", e->size, e->start, e->length);
+    } else {
+        emitName(buffer, e->fileName, format);
+        emit(buffer, format == EXPORT_CSV ? ",%ld,%ld,%ld\n" : " %-12ld%-12ld%ld\n", e->size, e->start, e->length);
+    }
+}
+
+
+/**
+ * Writes the blocks from..to-1 of a MemorySystem, and the files that have blocks among them, to
+ * a stream in one of the export formats, see the top of this file.
+ *
+ * @param system The MemorySystem to be exported.
+ * @param out The stream written to.
+ * @param format One of the EXPORT_ constants.
+ * @param from The first block to be exported.
+ * @param to One past the last block to be exported, or -1 for the end of the table. Ranges running
+ *           past the end of the table are cut off there.
+ * @return 0 if the state was written, -1 if from is not within the table, the buffer could not be
+ *         allocated or the stream failed.
+ */
+int exportSystem(MemorySystem* system, FILE* out, int format, long from, long to) {
+    BlockTable* table = &system->table;
+    Directory* d = &system->directory;
+    ExportBuffer buffer;
+    BlockRun run, next;
+    ExtentNode* node;
+    int first = 1;
+
+    if (to < 0 || to > table->length) {
+        to = table->length;
+    }
+    if (from < 0 || from >= to) {
+        printf("Block %ld is not within the table of %ld blocks.\n", from, table->length);
+        return -1;
+    }
+    buffer.out = out;
+    buffer.data = malloc(EXPORT_BUFFER_SIZE);
+    buffer.used = 0;
+    if (buffer.data == NULL) {
+        printf("Not enough memory to export the system.\n");
+        return -1;
+    }
+
+    if (format == EXPORT_RLE) {
+        emit(&buffer, "%-24s%-8s%-12s%s\n", "Blocks", "State", "Used", "Fragmented");
+    } else if (format == EXPORT_CSV) {
+        emit(&buffer, "start,length,in_use,used,fragmented\n");
+    } else {
+        emit(&buffer, "{\n  \"blockSize\": %ld,\n  \"blocks\": %ld,\n  \"from\": %ld,\n  \"to\": %ld,\n  \"runs\": [",
+             table->blockSize, table->length, from, to);
+    }
+
+    // Runs of the backend can end between blocks in the same state, so merge them before writing.
+    findRun(table, d, from, to, &run);
+    while (run.start + run.length < to) {
+        findRun(table, d, run.start + run.length, to, &next);
+        if (next.inUse == run.inUse && next.used == run.used) {
+            run.length += next.length;
+        } else {
+            emitRun(&buffer, format, &run, first);
+            first = 0;
+            run = next;
+        }
+    }
+    emitRun(&buffer, format, &run, first);
+
+    if (format == EXPORT_RLE) {
+        emit(&buffer, "\n%-32s %-12s%-12s%s\n", "File name", "Size", "Start", "Length");
+    } else if (format == EXPORT_CSV) {
+        emit(&buffer, "\nname,size,start,length\n");
+    } else {
+        emit(&buffer, "\n  ],\n  \"files\": [");
+    }
+    node = findFloorExtent(&d->extents, from);
+    if (node == NULL || node->start + node->length <= from) {
+        node = findCeilingExtent(&d->extents, from);
+    }
+    for (first = 1; node != NULL && node->start < to; node = findCeilingExtent(&d->extents, node->start + 1)) {
+        emitFile(&buffer, format, &d->list[node->owner], first);
+        first = 0;
+    }
+    if (format == EXPORT_JSON) {
+        emit(&buffer, "\n  ]\n}\n");
+    }
+
+    flushBuffer(&buffer);
+    free(buffer.data);
+    return fflush(out) == 0 && !ferror(out) ? 0 : -1;
+}
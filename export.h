@@ -0,0 +1,21 @@
+//
+// export.h
+//
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdio.h>
+#include "memorySystem.h"
+
+/* Formats the state of a MemorySystem can be exported in. */
+#define EXPORT_RLE 0
+#define EXPORT_CSV 1
+#define EXPORT_JSON 2
+#define EXPORT_FORMAT_COUNT 3
+
+int parseExportFormat(const char* name);
+const char* exportFormatName(int format);
+int exportSystem(MemorySystem* system, FILE* out, int format, long from, long to);
+
+#endif
@@ -0,0 +1,466 @@
+//
+// extentTree.c
+//
+
+#include "extentTree.h"
+#include "scanStats.h"
+#include <stdlib.h>
+
+
+/**
+ * Creates a new, empty ExtentTree.
+ *
+ * @param order ORDER_BY_START or ORDER_BY_LENGTH.
+ * @return An ExtentTree with no extents.
+ */
+ExtentTree createExtentTree(int order) {
+    ExtentTree tree;
+    tree.order = order;
+    tree.count = 0;
+    tree.root = NULL;
+    tree.spare = NULL;
+    return tree;
+}
+
+
+/**
+ * Frees every node below and including the given node.
+ */
+static void freeNodes(ExtentNode* node) {
+    while (node != NULL) {
+        ExtentNode* right = node->right;
+        freeNodes(node->left);
+        free(node);
+        node = right;
+    }
+}
+
+
+/**
+ * Frees all dynamically allocated memory held by an ExtentTree, including spare nodes.
+ *
+ * @param tree The ExtentTree to be destroyed.
+ */
+void destroyExtentTree(ExtentTree* tree) {
+    freeNodes(tree->root);
+    while (tree->spare != NULL) {
+        ExtentNode* next = tree->spare->right;
+        free(tree->spare);
+        tree->spare = next;
+    }
+    tree->root = NULL;
+    tree->count = 0;
+}
+
+
+/**
+ * Moves every node below and including the given node onto the spare list.
+ */
+static void spareNodes(ExtentTree* tree, ExtentNode* node) {
+    while (node != NULL) {
+        ExtentNode* right = node->right;
+        spareNodes(tree, node->left);
+        node->right = tree->spare;
+        tree->spare = node;
+        node = right;
+    }
+}
+
+
+/**
+ * Removes every extent from an ExtentTree, keeping the nodes for reuse.
+ *
+ * @param tree The ExtentTree to be cleared.
+ */
+void clearExtentTree(ExtentTree* tree) {
+    spareNodes(tree, tree->root);
+    tree->root = NULL;
+    tree->count = 0;
+}
+
+
+/**
+ * Compares an extent against a node using the ordering of the tree.
+ *
+ * @return Negative if the extent sorts before the node, positive if after, zero if equal.
+ */
+static int compareExtent(ExtentTree* tree, long start, long length, ExtentNode* node) {
+    if (tree->order == ORDER_BY_LENGTH && length != node->length) {
+        return length < node->length ? -1 : 1;
+    }
+    if (start != node->start) {
+        return start < node->start ? -1 : 1;
+    }
+    return 0;
+}
+
+
+static int heightOf(ExtentNode* node) {
+    return node == NULL ? 0 : node->height;
+}
+
+
+/**
+ * Recomputes the cached height and maxLength of a node from its children.
+ */
+static void refresh(ExtentNode* node) {
+    int leftHeight = heightOf(node->left);
+    int rightHeight = heightOf(node->right);
+    node->height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+
+    node->maxLength = node->length;
+    if (node->left != NULL && node->left->maxLength > node->maxLength) {
+        node->maxLength = node->left->maxLength;
+    }
+    if (node->right != NULL && node->right->maxLength > node->maxLength) {
+        node->maxLength = node->right->maxLength;
+    }
+}
+
+
+static ExtentNode* rotateRight(ExtentNode* node) {
+    ExtentNode* pivot = node->left;
+    node->left = pivot->right;
+    pivot->right = node;
+    refresh(node);
+    refresh(pivot);
+    return pivot;
+}
+
+
+static ExtentNode* rotateLeft(ExtentNode* node) {
+    ExtentNode* pivot = node->right;
+    node->right = pivot->left;
+    pivot->left = node;
+    refresh(node);
+    refresh(pivot);
+    return pivot;
+}
+
+
+/**
+ * Restores the AVL balance of a node whose subtrees differ in height by at most two.
+ *
+ * @return The new root of the subtree.
+ */
+static ExtentNode* rebalance(ExtentNode* node) {
+    refresh(node);
+    int balance = heightOf(node->left) - heightOf(node->right);
+    if (balance > 1) {
+        if (heightOf(node->left->left) < heightOf(node->left->right)) {
+            node->left = rotateLeft(node->left);
+        }
+        return rotateRight(node);
+    } else if (balance < -1) {
+        if (heightOf(node->right->right) < heightOf(node->right->left)) {
+            node->right = rotateRight(node->right);
+        }
+        return rotateLeft(node);
+    }
+    return node;
+}
+
+
+static ExtentNode* insertNode(ExtentTree* tree, ExtentNode* node, ExtentNode* added) {
+    if (node == NULL) {
+        return added;
+    }
+    if (compareExtent(tree, added->start, added->length, node) < 0) {
+        node->left = insertNode(tree, node->left, added);
+    } else {
+        node->right = insertNode(tree, node->right, added);
+    }
+    return rebalance(node);
+}
+
+
+/**
+ * Inserts a new extent into an ExtentTree. The extent must not already be in the tree.
+ *
+ * @param tree The ExtentTree being added to.
+ * @param start Index of the first block of the extent.
+ * @param length Number of blocks in the extent.
+ * @return The node now holding the extent.
+ */
+ExtentNode* insertExtent(ExtentTree* tree, long start, long length) {
+    ExtentNode* added = tree->spare;
+    if (added != NULL) {
+        tree->spare = added->right;
+    } else {
+        added = malloc(sizeof(ExtentNode));
+    }
+    added->start = start;
+    added->length = length;
+    added->maxLength = length;
+    added->owner = -1;
+    added->height = 1;
+    added->left = NULL;
+    added->right = NULL;
+
+    tree->root = insertNode(tree, tree->root, added);
+    tree->count++;
+    return added;
+}
+
+
+/**
+ * Detaches the leftmost node of a subtree.
+ *
+ * @param node Root of the subtree.
+ * @param minimum Set to the detached node.
+ * @return The new root of the subtree.
+ */
+static ExtentNode* detachMinimum(ExtentNode* node, ExtentNode** minimum) {
+    if (node->left == NULL) {
+        *minimum = node;
+        return node->right;
+    }
+    node->left = detachMinimum(node->left, minimum);
+    return rebalance(node);
+}
+
+
+static ExtentNode* removeNode(ExtentTree* tree, ExtentNode* node, long start, long length, ExtentNode** removed) {
+    if (node == NULL) {
+        return NULL;
+    }
+    int comparison = compareExtent(tree, start, length, node);
+    if (comparison < 0) {
+        node->left = removeNode(tree, node->left, start, length, removed);
+    } else if (comparison > 0) {
+        node->right = removeNode(tree, node->right, start, length, removed);
+    } else {
+        *removed = node;
+        if (node->left == NULL) {
+            return node->right;
+        } else if (node->right == NULL) {
+            return node->left;
+        }
+        ExtentNode* successor;
+        ExtentNode* right = detachMinimum(node->right, &successor);
+        successor->left = node->left;
+        successor->right = right;
+        return rebalance(successor);
+    }
+    return rebalance(node);
+}
+
+
+/**
+ * Removes an extent from an ExtentTree. Nothing happens if the extent is not in the tree.
+ * For trees ordered by start only the start index is used to find the extent.
+ *
+ * @param tree The ExtentTree being removed from.
+ * @param start Index of the first block of the extent.
+ * @param length Number of blocks in the extent.
+ */
+void removeExtent(ExtentTree* tree, long start, long length) {
+    ExtentNode* removed = NULL;
+    tree->root = removeNode(tree, tree->root, start, length, &removed);
+    if (removed != NULL) {
+        removed->right = tree->spare;
+        tree->spare = removed;
+        tree->count--;
+    }
+}
+
+
+static void trimNode(ExtentNode* node, long start, long length) {
+    if (start < node->start) {
+        trimNode(node->left, start, length);
+    } else if (start > node->start) {
+        trimNode(node->right, start, length);
+    } else {
+        node->start += length;
+        node->length -= length;
+    }
+    refresh(node);
+}
+
+
+/**
+ * Cuts blocks off of the front of an extent in place. Only the cached maxLength values on the
+ * path to the extent change, so no rotations are needed and no node is freed or allocated. Only
+ * valid for trees ordered by start, where the shorter extent keeps its place in the ordering.
+ *
+ * @param tree The ExtentTree holding the extent.
+ * @param start Index of the first block of the extent, which must be in the tree.
+ * @param length Number of blocks to cut off, fewer than the extent holds.
+ */
+void trimExtent(ExtentTree* tree, long start, long length) {
+    trimNode(tree->root, start, length);
+}
+
+
+/**
+ * Finds the extent with the greatest start index less than or equal to the given index.
+ * Only valid for trees ordered by start.
+ *
+ * @param tree The ExtentTree to be searched.
+ * @param start The block index to search for.
+ * @return The matching node, or NULL if every extent starts after the given index.
+ */
+ExtentNode* findFloorExtent(ExtentTree* tree, long start) {
+    ExtentNode* node = tree->root;
+    ExtentNode* result = NULL;
+    while (node != NULL) {
+        if (node->start <= start) {
+            result = node;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    return result;
+}
+
+
+/**
+ * Finds the extent with the smallest start index greater than or equal to the given index.
+ * Only valid for trees ordered by start.
+ *
+ * @param tree The ExtentTree to be searched.
+ * @param start The block index to search for.
+ * @return The matching node, or NULL if every extent starts before the given index.
+ */
+ExtentNode* findCeilingExtent(ExtentTree* tree, long start) {
+    ExtentNode* node = tree->root;
+    ExtentNode* result = NULL;
+    while (node != NULL) {
+        if (node->start >= start) {
+            result = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return result;
+}
+
+
+static ExtentNode* firstFitNode(ExtentNode* node, long minStart, long length) {
+    while (node != NULL) {
+        COUNT_SCAN(extentsExamined, 1);
+        if (node->maxLength < length) {  // Nothing under this node is long enough.
+            break;
+        }
+        if (node->start < minStart) {  // Everything on the left starts too early.
+            node = node->right;
+            continue;
+        }
+        ExtentNode* result = firstFitNode(node->left, minStart, length);
+        if (result != NULL) {
+            return result;
+        }
+        if (node->length >= length) {
+            return node;
+        }
+        node = node->right;
+    }
+    return NULL;
+}
+
+
+/**
+ * Finds the extent with the smallest start index that is at least minStart and holds at
+ * least the given number of blocks. Only valid for trees ordered by start.
+ *
+ * @param tree The ExtentTree to be searched.
+ * @param minStart Smallest start index to consider.
+ * @param length Number of blocks the extent must hold.
+ * @return The matching node, or NULL if no extent is large enough.
+ */
+ExtentNode* findFirstFitExtent(ExtentTree* tree, long minStart, long length) {
+    return firstFitNode(tree->root, minStart, length);
+}
+
+
+/**
+ * Finds the shortest extent holding at least the given number of blocks, preferring the
+ * lowest start index among extents of equal length. Only valid for trees ordered by length.
+ *
+ * @param tree The ExtentTree to be searched.
+ * @param length Number of blocks the extent must hold.
+ * @return The matching node, or NULL if no extent is large enough.
+ */
+ExtentNode* findBestFitExtent(ExtentTree* tree, long length) {
+    ExtentNode* node = tree->root;
+    ExtentNode* result = NULL;
+    while (node != NULL) {
+        COUNT_SCAN(extentsExamined, 1);
+        if (node->length >= length) {
+            result = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return result;
+}
+
+
+/**
+ * Finds the first extent in the tree's ordering.
+ *
+ * @param tree The ExtentTree to be searched.
+ * @return The first node, or NULL if the tree is empty.
+ */
+ExtentNode* findFirstExtent(ExtentTree* tree) {
+    ExtentNode* node = tree->root;
+    while (node != NULL && node->left != NULL) {
+        node = node->left;
+    }
+    return node;
+}
+
+
+/**
+ * Finds the last extent in the tree's ordering.
+ *
+ * @param tree The ExtentTree to be searched.
+ * @return The last node, or NULL if the tree is empty.
+ */
+ExtentNode* findLastExtent(ExtentTree* tree) {
+    ExtentNode* node = tree->root;
+    while (node != NULL && node->right != NULL) {
+        node = node->right;
+    }
+    return node;
+}
+
+
+static void collectOwners(ExtentNode* node, long from, long to, long* owners, long capacity, long* count) {
+    while (node != NULL) {
+        if (node->start < from) {  // Everything on the left starts too early.
+            node = node->right;
+        } else if (node->start >= to) {  // Everything on the right starts too late.
+            node = node->left;
+        } else {
+            collectOwners(node->left, from, to, owners, capacity, count);
+            if (*count < capacity) {
+                owners[*count] = node->owner;
+            }
+            (*count)++;
+            node = node->right;
+        }
+    }
+}
+
+
+/**
+ * Lists the owners of the extents starting at an index in [from, to), in order of start. Only
+ * visits the subtrees that can hold such extents, so it takes logarithmic time plus the number
+ * of extents found. Only valid for trees ordered by start.
+ *
+ * @param tree The ExtentTree to be searched.
+ * @param from The first start index to be included.
+ * @param to One past the last start index to be included.
+ * @param owners Receives the owners of the first capacity extents found.
+ * @param capacity Number of owners there is room for, may be 0 to only count the extents.
+ * @return The number of extents found, which may be more than capacity.
+ */
+long collectExtentOwners(ExtentTree* tree, long from, long to, long* owners, long capacity) {
+    long count = 0;
+    collectOwners(tree->root, from, to, owners, capacity, &count);
+    return count;
+}
@@ -0,0 +1,57 @@
+//
+// extentTree.h
+//
+
+#ifndef EXTENT_TREE_H
+#define EXTENT_TREE_H
+
+typedef struct extentNode ExtentNode;
+typedef struct extentTree ExtentTree;
+
+/* Orderings an ExtentTree can keep its extents in. */
+#define ORDER_BY_START 0
+#define ORDER_BY_LENGTH 1
+
+/**
+ * Definition of the ExtentNode type. One run of blocks [start, start + length) stored in an
+ * ExtentTree. maxLength caches the longest extent within the subtree rooted at this node so
+ * that searches for a run of a given length can skip whole subtrees. owner is not used by the
+ * tree itself, users of the tree can record what the extent belongs to there.
+ */
+struct extentNode {
+    long start;
+    long length;
+    long maxLength;
+    int height;
+    long owner;
+    ExtentNode* left;
+    ExtentNode* right;
+};
+
+/**
+ * Definition of the ExtentTree type. A balanced (AVL) search tree of non-overlapping extents,
+ * ordered either by start index or by (length, start). Removed nodes are kept on a spare list
+ * and reused, so steady-state inserts and removes do not call malloc.
+ */
+struct extentTree {
+    int order;
+    long count;
+    ExtentNode* root;
+    ExtentNode* spare;
+};
+
+ExtentTree createExtentTree(int order);
+void destroyExtentTree(ExtentTree* tree);
+void clearExtentTree(ExtentTree* tree);
+ExtentNode* insertExtent(ExtentTree* tree, long start, long length);
+void removeExtent(ExtentTree* tree, long start, long length);
+void trimExtent(ExtentTree* tree, long start, long length);
+ExtentNode* findFloorExtent(ExtentTree* tree, long start);
+ExtentNode* findCeilingExtent(ExtentTree* tree, long start);
+ExtentNode* findFirstFitExtent(ExtentTree* tree, long minStart, long length);
+ExtentNode* findBestFitExtent(ExtentTree* tree, long length);
+ExtentNode* findFirstExtent(ExtentTree* tree);
+ExtentNode* findLastExtent(ExtentTree* tree);
+long collectExtentOwners(ExtentTree* tree, long from, long to, long* owners, long capacity);
+
+#endif
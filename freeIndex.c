@@ -0,0 +1,257 @@
+//
+// freeIndex.c
+//
+
+#include "freeIndex.h"
+#include <stdlib.h>
+
+
+/**
+ * Adds an extent to both trees of a FreeIndex.
+ */
+static void addFree(FreeIndex* index, long start, long length) {
+    insertExtent(&index->byStart, start, length);
+    insertExtent(&index->byLength, start, length);
+}
+
+
+/**
+ * Removes an extent from both trees of a FreeIndex.
+ */
+static void removeFree(FreeIndex* index, long start, long length) {
+    removeExtent(&index->byStart, start, length);
+    removeExtent(&index->byLength, start, length);
+}
+
+
+/**
+ * Creates a new FreeIndex for a BlockTable whose blocks are all free.
+ *
+ * @param length Number of blocks in the BlockTable.
+ * @return A FreeIndex holding a single extent that covers the whole table.
+ */
+FreeIndex createFreeIndex(long length) {
+    FreeIndex index;
+    index.byStart = createExtentTree(ORDER_BY_START);
+    index.byLength = createExtentTree(ORDER_BY_LENGTH);
+    index.deferred = createExtentTree(ORDER_BY_START);
+    index.freeBlocks = 0;
+    resetFreeIndex(&index, length);
+    return index;
+}
+
+
+/**
+ * Frees all dynamically allocated memory held by a FreeIndex.
+ *
+ * @param index The FreeIndex to be destroyed.
+ */
+void destroyFreeIndex(FreeIndex* index) {
+    destroyExtentTree(&index->byStart);
+    destroyExtentTree(&index->byLength);
+    destroyExtentTree(&index->deferred);
+}
+
+
+/**
+ * Marks every block of the table as free again.
+ *
+ * @param index The FreeIndex to be reset.
+ * @param length Number of blocks in the BlockTable.
+ */
+void resetFreeIndex(FreeIndex* index, long length) {
+    clearExtentTree(&index->byStart);
+    clearExtentTree(&index->byLength);
+    clearExtentTree(&index->deferred);
+    index->freeBlocks = length;
+    if (length > 0) {
+        addFree(index, 0, length);
+    }
+}
+
+
+/**
+ * Finds the lowest block index where a run of free blocks of the given length begins.
+ *
+ * @param index The FreeIndex to be searched.
+ * @param blocksNeeded Number of contiguous free blocks needed.
+ * @return The index of the first block of the run, or -1 if no run is long enough.
+ */
+long findFirstFit(FreeIndex* index, long blocksNeeded) {
+    ExtentNode* node = findFirstFitExtent(&index->byStart, 0, blocksNeeded);
+    return node == NULL ? -1 : node->start;
+}
+
+
+/**
+ * Marks a run of blocks as allocated, splitting the free extent that contains it.
+ * The whole run must currently be free.
+ *
+ * @param index The FreeIndex being updated.
+ * @param start Index of the first block being allocated.
+ * @param length Number of blocks being allocated.
+ */
+void reserveExtent(FreeIndex* index, long start, long length) {
+    ExtentNode* containing = findFloorExtent(&index->byStart, start);
+    if (containing == NULL || containing->start + containing->length < start + length) {
+        return;  // The run is not entirely free, leave the index untouched.
+    }
+
+    long freeStart = containing->start;
+    long freeEnd = containing->start + containing->length;
+    removeFree(index, freeStart, freeEnd - freeStart);
+    if (freeStart < start) {  // Free space left in front of the allocation.
+        addFree(index, freeStart, start - freeStart);
+    }
+    if (start + length < freeEnd) {  // Free space left behind the allocation.
+        addFree(index, start + length, freeEnd - (start + length));
+    }
+    index->freeBlocks -= length;
+}
+
+
+/**
+ * Marks a run of blocks at the front of a free extent as allocated, like reserveExtent(), but
+ * only updates byStart, where the extent is shortened in place. byLength is left as it was until
+ * syncFreeIndex(), so a batch of allocations carved from the same extents pays for one byLength
+ * update per extent instead of two per allocation. First-fit searches of byStart stay exact in
+ * between, but no other FreeIndex function may be used until the index is synced.
+ *
+ * @param index The FreeIndex being updated.
+ * @param start Index of the first block of a free extent.
+ * @param length Number of blocks being allocated from the front of that extent.
+ */
+void deferReserve(FreeIndex* index, long start, long length) {
+    ExtentNode* containing = findFloorExtent(&index->byStart, start);
+    if (containing == NULL || containing->start != start || containing->length < length) {
+        return;  // Not the front of a free extent, leave the index untouched.
+    }
+
+    long end = start + containing->length;
+    ExtentNode* pending = findFloorExtent(&index->deferred, start);
+    if (pending == NULL || pending->start + pending->length != end) {  // First allocation from this extent.
+        insertExtent(&index->deferred, start, containing->length);
+    }
+    if (containing->length == length) {
+        removeExtent(&index->byStart, start, length);
+    } else {
+        trimExtent(&index->byStart, start, length);
+    }
+    index->freeBlocks -= length;
+}
+
+
+/**
+ * Brings byLength up to date after a batch of deferReserve() calls: the old entry of every extent
+ * the batch changed is replaced by what is left of the extent, if anything. Allocations only ever
+ * take the front of an extent, so what is left still ends where the extent did.
+ *
+ * @param index The FreeIndex to be synced.
+ */
+void syncFreeIndex(FreeIndex* index) {
+    ExtentNode* pending;
+    for (pending = findFirstExtent(&index->deferred); pending != NULL;
+         pending = findCeilingExtent(&index->deferred, pending->start + 1)) {
+        long end = pending->start + pending->length;
+        removeExtent(&index->byLength, pending->start, pending->length);
+        ExtentNode* rest = findFloorExtent(&index->byStart, end - 1);
+        if (rest != NULL && rest->start >= pending->start && rest->start + rest->length == end) {
+            insertExtent(&index->byLength, rest->start, rest->length);
+        }
+    }
+    clearExtentTree(&index->deferred);
+}
+
+
+/**
+ * Works out where first-fit placement would put a list of allocations made one after another,
+ * in one walk of byStart from the lowest block up, without changing the index. Every free extent
+ * the walk stops at is filled with the allocations still waiting that fit in what is left of it,
+ * in list order, which puts each at the lowest start a first-fit search would find after those
+ * before it. The walk only stops at extents that hold the smallest allocation still waiting, so
+ * each gets at least one and a list of n allocations costs at most n searches and n * n length
+ * comparisons, however many extents are skipped.
+ *
+ * @param index The FreeIndex to plan against, which must not have a batch pending.
+ * @param lengths Number of blocks of every allocation, in the order they are made. Allocations
+ *                of 0 blocks are not placed.
+ * @param count Number of allocations.
+ * @param starts Receives the first block of every allocation, or -1 if it would not fit.
+ * @return The number of blocks taken by the allocations that fit.
+ */
+long planFirstFit(FreeIndex* index, const long* lengths, long count, long* starts) {
+    long* waiting = malloc(sizeof(long) * (count > 0 ? count : 1));
+    long waitingCount = 0, cursor = 0, planned = 0;
+    long i, k;
+    for (i = 0; i < count; i++) {
+        starts[i] = -1;
+        if (lengths[i] > 0) {
+            waiting[waitingCount++] = i;
+        }
+    }
+
+    while (waitingCount > 0) {
+        long smallest = lengths[waiting[0]];
+        for (k = 1; k < waitingCount; k++) {
+            smallest = lengths[waiting[k]] < smallest ? lengths[waiting[k]] : smallest;
+        }
+        ExtentNode* node = findFirstFitExtent(&index->byStart, cursor, smallest);
+        if (node == NULL) {  // Extents passed over were shorter still, nothing left can be placed.
+            break;
+        }
+        long at = node->start, left = node->length, kept = 0;
+        for (k = 0; k < waitingCount; k++) {
+            i = waiting[k];
+            if (lengths[i] <= left) {
+                starts[i] = at;
+                at += lengths[i];
+                left -= lengths[i];
+                planned += lengths[i];
+            } else {
+                waiting[kept++] = i;
+            }
+        }
+        waitingCount = kept;
+        cursor = node->start + node->length;
+    }
+    free(waiting);
+    return planned;
+}
+
+
+/**
+ * Marks a run of allocated blocks as free, merging it with any free neighbours.
+ *
+ * @param index The FreeIndex being updated.
+ * @param start Index of the first block being freed.
+ * @param length Number of blocks being freed.
+ */
+void releaseExtent(FreeIndex* index, long start, long length) {
+    long mergedStart = start;
+    long mergedEnd = start + length;
+
+    ExtentNode* before = findFloorExtent(&index->byStart, start);
+    if (before != NULL && before->start + before->length == start) {
+        mergedStart = before->start;
+        removeFree(index, before->start, before->length);
+    }
+    ExtentNode* after = findCeilingExtent(&index->byStart, start + length);
+    if (after != NULL && after->start == start + length) {
+        mergedEnd = after->start + after->length;
+        removeFree(index, after->start, after->length);
+    }
+
+    addFree(index, mergedStart, mergedEnd - mergedStart);
+    index->freeBlocks += length;
+}
+
+
+/**
+ * Finds the length of the longest run of free blocks.
+ *
+ * @param index The FreeIndex to be checked.
+ * @return The number of blocks in the longest free run, 0 if the table is full.
+ */
+long largestFreeExtent(FreeIndex* index) {
+    return index->byStart.root == NULL ? 0 : index->byStart.root->maxLength;
+}
@@ -0,0 +1,37 @@
+//
+// freeIndex.h
+//
+
+#ifndef FREE_INDEX_H
+#define FREE_INDEX_H
+
+#include "extentTree.h"
+
+typedef struct freeIndex FreeIndex;
+
+/**
+ * Definition of the FreeIndex type. Tracks every maximal run of free blocks in a BlockTable,
+ * once ordered by start index (for first-fit searches and merging with neighbours) and once
+ * ordered by length (for size based searches). Both trees hold the same extents, except while a
+ * batch of allocations made with deferReserve() is pending: then byLength is out of date, and
+ * deferred holds the extents the batch has changed, as they were before it, until syncFreeIndex().
+ */
+struct freeIndex {
+    ExtentTree byStart;
+    ExtentTree byLength;
+    ExtentTree deferred;
+    long freeBlocks;
+};
+
+FreeIndex createFreeIndex(long length);
+void destroyFreeIndex(FreeIndex* index);
+void resetFreeIndex(FreeIndex* index, long length);
+long findFirstFit(FreeIndex* index, long blocksNeeded);
+void reserveExtent(FreeIndex* index, long start, long length);
+void releaseExtent(FreeIndex* index, long start, long length);
+void deferReserve(FreeIndex* index, long start, long length);
+void syncFreeIndex(FreeIndex* index);
+long planFirstFit(FreeIndex* index, const long* lengths, long count, long* starts);
+long largestFreeExtent(FreeIndex* index);
+
+#endif
@@ -0,0 +1,133 @@
+//
+// histogram.c
+//
+
+#include "histogram.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * Finds the bucket a value is counted in.
+ */
+static int bucketOf(uint64_t value) {
+    if (value < 2 * HISTOGRAM_SUB_COUNT) {
+        return (int) value;
+    }
+    int magnitude = 63 - __builtin_clzll(value);
+    int shift = magnitude - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HISTOGRAM_SUB_COUNT + (int) (value >> shift) - HISTOGRAM_SUB_COUNT;
+}
+
+
+/**
+ * Finds the largest value that is counted in a bucket.
+ */
+static uint64_t highestInBucket(int bucket) {
+    if (bucket < 2 * HISTOGRAM_SUB_COUNT) {
+        return (uint64_t) bucket;
+    }
+    int shift = bucket / HISTOGRAM_SUB_COUNT - 1;
+    uint64_t sub = (uint64_t) (bucket % HISTOGRAM_SUB_COUNT + HISTOGRAM_SUB_COUNT);
+    return (sub << shift) + ((1ULL << shift) - 1);
+}
+
+
+/**
+ * Creates a new, empty Histogram.
+ *
+ * @return A Histogram with no recorded values.
+ */
+Histogram createHistogram(void) {
+    Histogram h;
+    h.counts = calloc(HISTOGRAM_BUCKETS, sizeof(long));
+    h.total = 0;
+    h.min = UINT64_MAX;
+    h.max = 0;
+    h.sum = 0;
+    return h;
+}
+
+
+/**
+ * Frees all dynamically allocated memory held by a Histogram.
+ *
+ * @param histogram The Histogram to be destroyed.
+ */
+void destroyHistogram(Histogram* histogram) {
+    free(histogram->counts);
+    histogram->counts = NULL;
+}
+
+
+/**
+ * Forgets every value recorded in a Histogram.
+ *
+ * @param histogram The Histogram to be reset.
+ */
+void resetHistogram(Histogram* histogram) {
+    memset(histogram->counts, 0, sizeof(long) * HISTOGRAM_BUCKETS);
+    histogram->total = 0;
+    histogram->min = UINT64_MAX;
+    histogram->max = 0;
+    histogram->sum = 0;
+}
+
+
+/**
+ * Records a single value in a Histogram.
+ *
+ * @param histogram The Histogram the value is counted in.
+ * @param value The value to be recorded.
+ */
+void recordValue(Histogram* histogram, uint64_t value) {
+    histogram->counts[bucketOf(value)]++;
+    histogram->total++;
+    histogram->sum += (double) value;
+    if (value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+
+/**
+ * Finds the value below or at which the given percentage of recorded values fall. The result is
+ * the largest value of the bucket the percentile lands in, capped at the largest recorded value.
+ *
+ * @param histogram The Histogram to be queried.
+ * @param percentile Percentage between 0 and 100.
+ * @return The value at the percentile, or 0 if nothing has been recorded.
+ */
+uint64_t valueAtPercentile(Histogram* histogram, double percentile) {
+    long wanted = (long) (percentile / 100 * histogram->total + 0.5);
+    long seen = 0;
+    int i;
+    if (histogram->total == 0) {
+        return 0;
+    }
+    if (wanted < 1) {
+        wanted = 1;
+    }
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= wanted) {
+            uint64_t value = highestInBucket(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+
+/**
+ * Computes the mean of the values recorded in a Histogram.
+ *
+ * @param histogram The Histogram to be queried.
+ * @return The exact mean, or 0 if nothing has been recorded.
+ */
+double histogramMean(Histogram* histogram) {
+    return histogram->total == 0 ? 0 : histogram->sum / histogram->total;
+}
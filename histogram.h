@@ -0,0 +1,39 @@
+//
+// histogram.h
+//
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+typedef struct histogram Histogram;
+
+/* Every power-of-two range of values is split into 2^HISTOGRAM_SUB_BITS buckets, so recorded
+ * values are kept to within 1 / 2^HISTOGRAM_SUB_BITS of their true value. */
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((65 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB_COUNT)
+
+/**
+ * Definition of the Histogram type. Counts recorded values, such as latencies in nanoseconds,
+ * in log-linear buckets the way an HDR histogram does: values below 2 * HISTOGRAM_SUB_COUNT get
+ * a bucket each, and every larger power-of-two range is split into HISTOGRAM_SUB_COUNT buckets.
+ * Recording is a constant time array increment regardless of the range of the values.
+ */
+struct histogram {
+    long* counts;
+    long total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+};
+
+Histogram createHistogram(void);
+void destroyHistogram(Histogram* histogram);
+void resetHistogram(Histogram* histogram);
+void recordValue(Histogram* histogram, uint64_t value);
+uint64_t valueAtPercentile(Histogram* histogram, double percentile);
+double histogramMean(Histogram* histogram);
+
+#endif
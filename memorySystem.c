@@ -0,0 +1,514 @@
+//
+// memorySystem.c
+//
+
+#include "memorySystem.h"
+#include "scanStats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Number of entries a new Directory has room for before it first grows. */
+#define DIRECTORY_START_LENGTH 1024
+
+/**
+ * The size, name and position of one request of a batch, sorted to choose the order files are
+ * added in and to find names the batch repeats.
+ */
+typedef struct batchKey {
+    long size;
+    long index;
+    char* name;
+} BatchKey;
+
+
+/**
+ * Checks that a storage device of the given size can be modelled, printing the reason if not.
+ * The block size must divide the system size and fit the BlockTable's per-block columns, and
+ * the number of blocks must not exceed MAX_TABLE_BLOCKS.
+ *
+ * @param systemSize Total size of the storage device.
+ * @param blockSize Size of each block on the storage device.
+ * @return 0 if a MemorySystem of this size can be created, -1 otherwise.
+ */
+int checkSystemSize(long systemSize, long blockSize) {
+    if (systemSize <= 0 || blockSize <= 0) {
+        printf("Storage and block sizes must be positive.\n");
+        return -1;
+    } else if (blockSize > systemSize || systemSize % blockSize != 0) {
+        printf("Storage size must be a multiple of the block size.\n");
+        return -1;
+    } else if (blockSize > MAX_BLOCK_SIZE) {
+        printf("Block size may not be larger than %ld.\n", (long) MAX_BLOCK_SIZE);
+        return -1;
+    } else if (systemSize / blockSize > MAX_TABLE_BLOCKS) {
+        printf("Storage may not have more than %ld blocks.\n", MAX_TABLE_BLOCKS);
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * Creates a new MemorySystem with a BlockTable and Directory sized for the given device.
+ * The caller is responsible for checking the sizes with checkSystemSize() first.
+ *
+ * @param systemSize Total size of the storage device.
+ * @param blockSize Size of each block on the storage device.
+ * @param policy The POLICY_ constant of the placement policy used for new files.
+ * @param backend The TABLE_ constant of the BlockTable backend.
+ * @return A MemorySystem with an empty BlockTable and Directory, and compaction turned off.
+ */
+MemorySystem createMemorySystem(long systemSize, long blockSize, int policy, int backend) {
+    MemorySystem system;
+    long blocks = systemSize / blockSize;
+    system.table = createBlockTable(blockSize, blocks, backend);
+    system.directory = createDirectory(blocks < DIRECTORY_START_LENGTH ? blocks : DIRECTORY_START_LENGTH);
+    system.placement = createPlacement(policy, systemSize / blockSize);
+    system.compactor = createCompactor(COMPACT_OFF, 0);
+    system.log = NULL;
+    return system;
+}
+
+
+/**
+ * Frees all dynamically allocated memory held by a MemorySystem. If it has an EventLog, a last
+ * sample is taken and the log is closed.
+ *
+ * @param system The MemorySystem to be destroyed.
+ */
+void destroyMemorySystem(MemorySystem* system) {
+    if (system->log != NULL) {
+        logSample(system->log, &system->table);
+        closeEventLog(system->log);
+        free(system->log);
+        system->log = NULL;
+    }
+    destroyDirectory(&system->directory);
+    destroyBlockTable(&system->table);
+    destroyPlacement(&system->placement);
+}
+
+
+/**
+ * Determines how many blocks of a BlockTable a file of the given size occupies.
+ *
+ * @param bTable The BlockTable the file would be stored in.
+ * @param fileSize Size of the file.
+ * @return The number of blocks needed to store the file.
+ */
+long blocksForSize(BlockTable* bTable, long fileSize) {
+    long blockSize = bTable->blockSize;
+    if (fileSize <= blockSize) {
+        return 1;
+    } else if (fileSize % blockSize == 0) {
+        return fileSize / blockSize;
+    } else {
+        return (fileSize / blockSize) + 1;
+    }
+}
+
+
+/**
+ * Checks the BlockTable to see if there is enough contiguous memory available to add a new file.
+ * Will return the index of the first open block with enough space to store the entire file if possible,
+ * if there is not enough space in memory for the new file it will return -1. The search runs against
+ * the table's free index, so it takes logarithmic time in the number of free extents.
+ *
+ * @param bTable The BlockTable to be checked for available space.
+ * @param fileSize The size of the file attempting to be added.
+ * @return The index of where the file should be stored if space is available, or -1 if there is none available.
+ */
+long checkForSpace(BlockTable* bTable, long fileSize) {
+    long costBefore = SCAN_COST();
+    long start = findFirstFit(&bTable->freeIndex, blocksForSize(bTable, fileSize));
+    COUNT_SEARCH(start, costBefore);
+    return start;
+}
+
+
+/**
+ * Does the work of addFileToSystem() apart from the event log.
+ */
+static int storeFile(MemorySystem* system, char* fileName, long fileSize, long* start) {
+    BlockTable* table = &system->table;
+    *start = -1;
+    if (strlen(fileName) >= MAX_FILE_NAME) {  // Checked first, the Directory could not take the name once the blocks are claimed.
+        return SYSTEM_BAD_NAME;
+    } else if (findEntryInDirectory(&system->directory, fileName) >= 0) {
+        return SYSTEM_DUPLICATE;
+    }
+
+    long blocksNeeded = blocksForSize(table, fileSize);
+    long newFileIndex = choosePlacement(&system->placement, table, blocksNeeded);
+    if (newFileIndex < 0 && system->compactor.mode != COMPACT_OFF && table->freeIndex.freeBlocks >= blocksNeeded) {
+        compactTable(&system->compactor, table, &system->directory, -1);
+        system->compactor.passes++;
+        newFileIndex = choosePlacement(&system->placement, table, blocksNeeded);
+        if (newFileIndex >= 0) {
+            system->compactor.rescuedAdds++;
+        }
+    }
+    *start = newFileIndex;
+    if (newFileIndex < 0) {  // Not enough space for the new file.
+        return SYSTEM_NO_SPACE;
+    }
+
+    Entry newEntry = createEntry(fileName, fileSize, newFileIndex, blocksNeeded);
+    updateTable(table, newFileIndex, fileSize);
+    addToDirectory(&system->directory, newEntry);
+    return SYSTEM_OK;
+}
+
+
+/**
+ * Stores a new file in the system, updating both the BlockTable and the Directory. The location
+ * of the file is chosen by the system's placement policy. If compaction is turned on and the file
+ * does not fit, but enough blocks are free in total, the table is fully compacted and the
+ * placement is tried again.
+ *
+ * @param system The MemorySystem the file is added to.
+ * @param fileName Name of the new file.
+ * @param fileSize Size of the new file, must be greater than zero.
+ * @return SYSTEM_OK if the file was added, SYSTEM_NO_SPACE if there is not enough contiguous memory,
+ *         SYSTEM_DUPLICATE if a file with the same name is already stored, SYSTEM_BAD_NAME if the
+ *         name is MAX_FILE_NAME bytes or longer.
+ */
+int addFileToSystem(MemorySystem* system, char* fileName, long fileSize) {
+    long start = -1;
+    if (system->log != NULL) {
+        startEvent(system->log);
+    }
+    int result = storeFile(system, fileName, fileSize, &start);
+    if (system->log != NULL && result != SYSTEM_DUPLICATE && result != SYSTEM_BAD_NAME) {
+        logEvent(system->log, result == SYSTEM_OK ? EVENT_ADD : EVENT_NO_SPACE, start,
+                 blocksForSize(&system->table, fileSize), &system->table);
+    }
+    return result;
+}
+
+
+/**
+ * Orders the requests of a batch by size, largest first, and by position among equal sizes.
+ */
+static int compareBatchKeys(const void* a, const void* b) {
+    const BatchKey* x = a;
+    const BatchKey* y = b;
+    if (x->size != y->size) {
+        return x->size > y->size ? -1 : 1;
+    }
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+
+/**
+ * Orders the requests of a batch by name, and by position among equal names.
+ */
+static int compareBatchNames(const void* a, const void* b) {
+    const BatchKey* x = a;
+    const BatchKey* y = b;
+    int names = strcmp(x->name, y->name);
+    if (names != 0) {
+        return names;
+    }
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+
+/**
+ * Sets the result of every request of a batch whose name cannot be added: SYSTEM_BAD_NAME if it
+ * is too long, SYSTEM_DUPLICATE if it is stored already. Every other request is set to
+ * SYSTEM_OK, to be placed. A name given by more than one request is left to be decided when the
+ * requests are placed, since a later copy is only a duplicate if an earlier one finds space.
+ *
+ * @return The number of requests whose name an earlier request of the batch also gives.
+ */
+static long checkBatchNames(MemorySystem* system, BatchRequest* requests, long count) {
+    BatchKey* byName = malloc(sizeof(BatchKey) * (count > 0 ? count : 1));
+    long i, repeated = 0;
+    for (i = 0; i < count; i++) {
+        byName[i].name = requests[i].fileName;
+        byName[i].index = i;
+    }
+    qsort(byName, count, sizeof(BatchKey), compareBatchNames);
+    for (i = 0; i < count; i++) {
+        BatchRequest* r = &requests[byName[i].index];
+        r->start = -1;
+        if (i > 0 && strcmp(byName[i - 1].name, r->fileName) == 0) {
+            repeated++;
+        }
+        if (strlen(r->fileName) >= MAX_FILE_NAME) {
+            r->result = SYSTEM_BAD_NAME;
+        } else if (findEntryInDirectory(&system->directory, r->fileName) >= 0) {
+            r->result = SYSTEM_DUPLICATE;
+        } else {
+            r->result = SYSTEM_OK;
+        }
+    }
+    free(byName);
+    return repeated;
+}
+
+
+/**
+ * Plans first-fit placement of the requests of a batch still set to SYSTEM_OK, added in the
+ * given order, with planFirstFit(). starts is indexed like order.
+ *
+ * @return The number of blocks the requests that fit take up.
+ */
+static long planBatch(MemorySystem* system, BatchRequest* requests, BatchKey* order, long count, long* lengths,
+                      long* starts) {
+    long i;
+    for (i = 0; i < count; i++) {
+        BatchRequest* r = &requests[order[i].index];
+        lengths[i] = r->result == SYSTEM_OK ? blocksForSize(&system->table, r->size) : 0;
+    }
+    return planFirstFit(&system->table.freeIndex, lengths, count, starts);
+}
+
+
+/**
+ * Stores a batch of new files in the system in one call, setting the result of every request
+ * and placing every file where one addFileToSystem() call each, in the order added, would. The
+ * Directory is grown once for the whole batch.
+ *
+ * With first-fit or scan placement and compaction off, the batch is placed in one walk of the
+ * free extents (see planFirstFit()), unless two requests of the batch give the same name, as the
+ * later one is then only a duplicate if the earlier one finds space. The files are carved from the front of their extents, so the free index's length
+ * ordering is brought up to date once per batch rather than once per file (see deferReserve()).
+ * Asked to add the largest files first, the batch is planned in both orders, and the given order
+ * is kept if it would place more blocks. Other policies, compaction and batches repeating a name
+ * place each file as addFileToSystem() does, in the order asked for. If the system has an EventLog the batch is
+ * recorded as one operation.
+ *
+ * @param system The MemorySystem the files are added to.
+ * @param requests The files to be added. result and start are set for every request: one of the
+ *                 SYSTEM_ codes addFileToSystem() returns, and the first block of the file or -1.
+ * @param count Number of requests.
+ * @param sortBySize 0 to add the files in the order given, 1 to add the largest files first,
+ *                   which usually packs the batch more tightly.
+ * @return The number of files added.
+ */
+long addFilesToSystem(MemorySystem* system, BatchRequest* requests, long count, int sortBySize) {
+    BlockTable* table = &system->table;
+    Directory* directory = &system->directory;
+    int policy = system->placement.policy;
+    int deferred = (policy == POLICY_FIRST_FIT || policy == POLICY_SCAN) && system->compactor.mode == COMPACT_OFF;
+    long passes = system->compactor.passes;
+    long i, added = 0, blocksAdded = 0;
+    long* lengths = NULL;
+    long* starts = NULL;
+
+    if (system->log != NULL) {
+        startEvent(system->log);
+    }
+    if (checkBatchNames(system, requests, count) > 0) {
+        deferred = 0;
+    }
+    BatchKey* order = malloc(sizeof(BatchKey) * (count > 0 ? count : 1) * 2);
+    BatchKey* sorted = order + count;
+    for (i = 0; i < count; i++) {
+        order[i].size = requests[i].size;
+        order[i].index = i;
+        sorted[i] = order[i];
+    }
+    if (sortBySize) {
+        qsort(sorted, count, sizeof(BatchKey), compareBatchKeys);
+    }
+    reserveDirectory(directory, count);
+
+    if (deferred) {
+        lengths = malloc(sizeof(long) * (count > 0 ? count : 1) * 3);
+        starts = lengths + count;
+        long planned = planBatch(system, requests, order, count, lengths, starts);
+        if (sortBySize && planBatch(system, requests, sorted, count, lengths, starts + count) >= planned) {
+            memcpy(order, sorted, sizeof(BatchKey) * count);
+            starts += count;
+        }
+    } else if (sortBySize) {
+        memcpy(order, sorted, sizeof(BatchKey) * count);
+    }
+
+    for (i = 0; i < count; i++) {
+        BatchRequest* r = &requests[order[i].index];
+        if (r->result != SYSTEM_OK) {
+            continue;
+        } else if (!deferred) {
+            r->result = storeFile(system, r->fileName, r->size, &r->start);
+        } else if (starts[i] < 0) {
+            r->result = SYSTEM_NO_SPACE;
+        } else {
+            long blocksNeeded = blocksForSize(table, r->size);
+            r->start = starts[i];
+            deferReserve(&table->freeIndex, r->start, blocksNeeded);
+            claimTable(table, r->start, r->size);
+            addToDirectory(directory, createEntry(r->fileName, r->size, r->start, blocksNeeded));
+        }
+        if (r->result == SYSTEM_OK) {
+            added++;
+            blocksAdded += blocksForSize(table, r->size);
+        }
+    }
+    if (deferred) {
+        syncFreeIndex(&table->freeIndex);
+        free(lengths);
+    }
+    for (i = 0; i < count && system->compactor.passes != passes; i++) {  // Compaction may have moved files.
+        if (requests[i].result == SYSTEM_OK) {
+            requests[i].start = directory->list[findEntryInDirectory(directory, requests[i].fileName)].start;
+        }
+    }
+    free(order);
+
+    if (system->log != NULL) {
+        logEvent(system->log, EVENT_BATCH, -1, blocksAdded, table);
+    }
+    return added;
+}
+
+
+/**
+ * Removes a file from the system, freeing its blocks in the BlockTable and its Directory Entry.
+ *
+ * @param system The MemorySystem the file is deleted from.
+ * @param fileName Name of the file to be deleted.
+ * @return SYSTEM_OK if the file was deleted, SYSTEM_NOT_FOUND if no file has that name.
+ */
+int deleteFileFromSystem(MemorySystem* system, char* fileName) {
+    Directory* directory = &system->directory;
+    if (system->log != NULL) {
+        startEvent(system->log);
+    }
+    long fileIndex = findEntryInDirectory(directory, fileName);
+    if (fileIndex < 0) {
+        return SYSTEM_NOT_FOUND;
+    }
+
+    // Reset the BlockTable elements belonging to the deleted file.
+    Entry* e = &directory->list[fileIndex];
+    releaseTable(&system->table, e->start, e->length);
+    releasePlacement(&system->placement, e->start, e->length);
+
+    // Remove the Entry from the Directory.
+    long start = e->start, length = e->length;
+    deleteFromDirectory(directory, fileIndex);
+    if (system->log != NULL) {
+        logEvent(system->log, EVENT_DELETE, start, length, &system->table);
+    }
+    return SYSTEM_OK;
+}
+
+
+/**
+ * Turns compaction on or off for a system. Compaction moves files, which the buddy policy's
+ * free lists cannot follow, so it cannot be turned on for systems using buddy placement.
+ *
+ * @param system The MemorySystem being configured.
+ * @param mode One of the COMPACT_ constants.
+ * @param stepBlocks Most blocks moved by one incremental step, only used by COMPACT_INCREMENTAL.
+ * @return 0 if the setting was applied, -1 if the placement policy does not allow compaction.
+ */
+int setCompaction(MemorySystem* system, int mode, long stepBlocks) {
+    if (mode != COMPACT_OFF && system->placement.policy == POLICY_BUDDY) {
+        return -1;
+    }
+    system->compactor.mode = mode;
+    system->compactor.stepBlocks = stepBlocks;
+    return 0;
+}
+
+
+/**
+ * Grows or shrinks the storage device of a system while it holds files. The BlockTable and the
+ * Placement are extended or cut back at their end rather than rebuilt, see resizeTable(), and the
+ * Directory already grows on its own as files are added. A system can only shrink if the blocks
+ * being removed are free; with compaction turned on the files are compacted to the front first
+ * when they are not.
+ *
+ * @param system The MemorySystem to be resized.
+ * @param systemSize The new total size of the storage device, a multiple of its block size.
+ * @return 0 if the system was resized, -1 if the size is invalid or files are in the way.
+ */
+int resizeSystem(MemorySystem* system, long systemSize) {
+    BlockTable* table = &system->table;
+    long oldLength = table->length;
+    if (checkSystemSize(systemSize, table->blockSize) != 0) {
+        return -1;
+    }
+
+    long newLength = systemSize / table->blockSize;
+    int result = resizeTable(table, newLength);
+    if (result != 0 && system->compactor.mode != COMPACT_OFF && table->freeIndex.freeBlocks >= oldLength - newLength) {
+        compactTable(&system->compactor, table, &system->directory, -1);
+        system->compactor.passes++;
+        result = resizeTable(table, newLength);
+    }
+    if (result == 0 && resizePlacement(&system->placement, oldLength, newLength) != 0) {
+        resizeTable(table, oldLength);  // Growing back to the old length always succeeds.
+        result = -1;
+    }
+    if (result != 0) {
+        printf("Files are stored past block %ld, the system cannot shrink to %ld bytes.\n", newLength, systemSize);
+    }
+    return result;
+}
+
+
+/**
+ * Starts recording the operations of a system in a new EventLog, sampling the table's metrics
+ * every sampleEvery operations.
+ *
+ * @param system The MemorySystem to be logged.
+ * @param path Path of the CSV file the log is written to, see eventLog.c.
+ * @param sampleEvery Number of operations between samples, at least one.
+ * @return 0 if the log was opened, -1 if its file could not be created.
+ */
+int openSystemLog(MemorySystem* system, const char* path, long sampleEvery) {
+    EventLog* log = malloc(sizeof(EventLog));
+    if (openEventLog(log, path, sampleEvery) != 0) {
+        free(log);
+        return -1;
+    }
+    system->log = log;
+    logSample(log, &system->table);
+    return 0;
+}
+
+
+/**
+ * Runs one bounded incremental compaction step, if the system is in COMPACT_INCREMENTAL mode.
+ * Meant to be called between operations.
+ *
+ * @param system The MemorySystem to be compacted.
+ */
+void stepCompaction(MemorySystem* system) {
+    if (system->compactor.mode == COMPACT_INCREMENTAL) {
+        compactTable(&system->compactor, &system->table, &system->directory, system->compactor.stepBlocks);
+    }
+}
+
+
+/**
+ * Prints the Directory and BlockTable of a MemorySystem to console.
+ *
+ * @param system The MemorySystem to be printed.
+ */
+void printSystem(MemorySystem* system) {
+    printf("-------------------------------------------\n");
+    printDirectory(&system->directory);
+    printf("-------------------------------------------\n");
+    printTable(&system->table);
+    printf("-------------------------------------------\n\n");
+}
+
+
+/**
+ * Prints the number of files and the utilization and fragmentation metrics of a MemorySystem
+ * to console, without walking the BlockTable.
+ *
+ * @param system The MemorySystem to be summarized.
+ */
+void printSystemSummary(MemorySystem* system) {
+    printf("Files stored:\t\t%ld\n", system->directory.size);
+    printTableMetrics(&system->table);
+}
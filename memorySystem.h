@@ -0,0 +1,65 @@
+//
+// memorySystem.h
+//
+
+#ifndef MEMORY_SYSTEM_H
+#define MEMORY_SYSTEM_H
+
+#include "blockTable.h"
+#include "directory.h"
+#include "placement.h"
+#include "compactor.h"
+#include "eventLog.h"
+
+/* Result codes returned by the MemorySystem file operations. */
+#define SYSTEM_OK 0
+#define SYSTEM_NO_SPACE -1
+#define SYSTEM_NOT_FOUND -2
+#define SYSTEM_DUPLICATE -3
+#define SYSTEM_BAD_NAME -4
+
+typedef struct memorySystem MemorySystem;
+typedef struct batchRequest BatchRequest;
+
+/**
+ * Definition of the MemorySystem type. Bundles the BlockTable and Directory that together
+ * represent one simulated storage device, along with the Placement policy deciding where new
+ * files go and the Compactor settings, so that the interactive driver and trace replay share the
+ * same add and delete logic. log is NULL unless an EventLog has been opened with openSystemLog(),
+ * in which case the system owns it and every add, delete and failed add is recorded in it.
+ */
+struct memorySystem {
+    BlockTable table;
+    Directory directory;
+    Placement placement;
+    Compactor compactor;
+    EventLog* log;
+};
+
+/**
+ * Definition of the BatchRequest type. One file of a batch given to addFilesToSystem(), which
+ * sets result to one of the SYSTEM_ codes and start to the file's first block, or -1.
+ */
+struct batchRequest {
+    char* fileName;
+    long size;
+    int result;
+    long start;
+};
+
+int checkSystemSize(long systemSize, long blockSize);
+MemorySystem createMemorySystem(long systemSize, long blockSize, int policy, int backend);
+void destroyMemorySystem(MemorySystem* system);
+long blocksForSize(BlockTable* bTable, long fileSize);
+long checkForSpace(BlockTable* bTable, long fileSize);
+int addFileToSystem(MemorySystem* system, char* fileName, long fileSize);
+long addFilesToSystem(MemorySystem* system, BatchRequest* requests, long count, int sortBySize);
+int deleteFileFromSystem(MemorySystem* system, char* fileName);
+int setCompaction(MemorySystem* system, int mode, long stepBlocks);
+int resizeSystem(MemorySystem* system, long systemSize);
+int openSystemLog(MemorySystem* system, const char* path, long sampleEvery);
+void stepCompaction(MemorySystem* system);
+void printSystem(MemorySystem* system);
+void printSystemSummary(MemorySystem* system);
+
+#endif
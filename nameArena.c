@@ -0,0 +1,101 @@
+//
+// nameArena.c
+//
+
+#include "nameArena.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * Finds the size class of a name, slot sizes go up in steps of NAME_SLOT_ALIGN bytes.
+ *
+ * @return The size class, or -1 if the name is too long for any class.
+ */
+static int nameClass(const char* name) {
+    long slotClass = (long) (strlen(name) + 1 + NAME_SLOT_ALIGN - 1) / NAME_SLOT_ALIGN - 1;
+    return slotClass < NAME_CLASSES ? (int) slotClass : -1;
+}
+
+
+/**
+ * Creates a new, empty NameArena. No memory is allocated until the first name is stored.
+ *
+ * @return A NameArena with no chunks.
+ */
+NameArena createNameArena(void) {
+    NameArena arena;
+    int i;
+    arena.chunks = NULL;
+    arena.chunkCount = 0;
+    arena.chunkCapacity = 0;
+    arena.chunkUsed = NAME_CHUNK_SIZE;  // Forces a chunk to be allocated for the first name.
+    for (i = 0; i < NAME_CLASSES; i++) {
+        arena.freeLists[i] = NULL;
+    }
+    return arena;
+}
+
+
+/**
+ * Frees every chunk of a NameArena at once. All names stored in it become invalid.
+ *
+ * @param arena The NameArena to be destroyed.
+ */
+void destroyNameArena(NameArena* arena) {
+    int i;
+    for (i = 0; i < arena->chunkCount; i++) {
+        free(arena->chunks[i]);
+    }
+    free(arena->chunks);
+    *arena = createNameArena();
+}
+
+
+/**
+ * Copies a name into the arena, reusing a released slot of the same size class if there is one.
+ *
+ * @param arena The NameArena the name is stored in.
+ * @param name The name to be copied.
+ * @return The stored copy of the name, or NULL if the name is too long to store.
+ */
+char* storeName(NameArena* arena, const char* name) {
+    int slotClass = nameClass(name);
+    char* slot;
+    if (slotClass < 0) {
+        return NULL;
+    }
+
+    if (arena->freeLists[slotClass] != NULL) {
+        slot = arena->freeLists[slotClass];
+        memcpy(&arena->freeLists[slotClass], slot, sizeof(char*));
+    } else {
+        long slotSize = (long) (slotClass + 1) * NAME_SLOT_ALIGN;
+        if (arena->chunkUsed + slotSize > NAME_CHUNK_SIZE) {  // Current chunk is full, start a new one.
+            if (arena->chunkCount == arena->chunkCapacity) {
+                arena->chunkCapacity = arena->chunkCapacity == 0 ? 16 : arena->chunkCapacity * 2;
+                arena->chunks = realloc(arena->chunks, sizeof(char*) * arena->chunkCapacity);
+            }
+            arena->chunks[arena->chunkCount++] = malloc(NAME_CHUNK_SIZE);
+            arena->chunkUsed = 0;
+        }
+        slot = arena->chunks[arena->chunkCount - 1] + arena->chunkUsed;
+        arena->chunkUsed += slotSize;
+    }
+
+    strcpy(slot, name);
+    return slot;
+}
+
+
+/**
+ * Returns the slot of a stored name to the free list of its size class.
+ *
+ * @param arena The NameArena the name was stored in.
+ * @param name A name returned by storeName() that has not been released yet.
+ */
+void releaseName(NameArena* arena, char* name) {
+    int slotClass = nameClass(name);
+    memcpy(name, &arena->freeLists[slotClass], sizeof(char*));
+    arena->freeLists[slotClass] = name;
+}
@@ -0,0 +1,35 @@
+//
+// nameArena.h
+//
+
+#ifndef NAME_ARENA_H
+#define NAME_ARENA_H
+
+typedef struct nameArena NameArena;
+
+/* Size of each chunk of name storage, and the granularity names are rounded up to. */
+#define NAME_CHUNK_SIZE 65536
+#define NAME_SLOT_ALIGN 8
+#define NAME_CLASSES 16
+
+/**
+ * Definition of the NameArena type. Stores file names back to back in large chunks instead of
+ * one malloc per name. Each name takes a slot rounded up to a multiple of NAME_SLOT_ALIGN bytes,
+ * and released slots go onto a free list for their size class to be reused by later names, so
+ * the memory held is bounded by the most names alive at once. Chunks never move, so pointers
+ * to stored names stay valid until the name is released.
+ */
+struct nameArena {
+    char** chunks;
+    int chunkCount;
+    int chunkCapacity;
+    long chunkUsed;
+    char* freeLists[NAME_CLASSES];
+};
+
+NameArena createNameArena(void);
+void destroyNameArena(NameArena* arena);
+char* storeName(NameArena* arena, const char* name);
+void releaseName(NameArena* arena, char* name);
+
+#endif
@@ -0,0 +1,335 @@
+//
+// placement.c
+//
+
+#include "placement.h"
+#include "bitmap.h"
+#include "scanStats.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* policyNames[POLICY_COUNT] = {"first", "next", "best", "worst", "buddy", "scan"};
+
+
+/**
+ * Finds the smallest order whose blocks hold at least the given number of blocks.
+ */
+static int orderFor(long blocks) {
+    int order = 0;
+    while ((1L << order) < blocks) {
+        order++;
+    }
+    return order;
+}
+
+
+/**
+ * Finds the largest order whose blocks fit in a table of the given length.
+ */
+static int maxOrderFor(long length) {
+    int order = 0;
+    while ((2L << order) <= length) {
+        order++;
+    }
+    return order;
+}
+
+
+/**
+ * Changes the number of buddy free lists of a Placement. Lists dropped must be empty.
+ */
+static void setMaxOrder(Placement* placement, int maxOrder) {
+    int order;
+    for (order = maxOrder + 1; order <= placement->maxOrder; order++) {
+        destroyExtentTree(&placement->buddyFree[order]);
+    }
+    placement->buddyFree = realloc(placement->buddyFree, sizeof(ExtentTree) * (maxOrder + 1));
+    for (order = placement->maxOrder + 1; order <= maxOrder; order++) {
+        placement->buddyFree[order] = createExtentTree(ORDER_BY_START);
+    }
+    placement->maxOrder = maxOrder;
+}
+
+
+/**
+ * Gives the blocks [from, to) to the buddy free lists, carved into the largest aligned
+ * power-of-two blocks that fit, each merged with its buddy if that is free.
+ */
+static void freeBuddyRange(Placement* placement, long from, long to) {
+    while (from < to) {
+        int order = placement->maxOrder;
+        while ((from & ((1L << order) - 1)) != 0 || from + (1L << order) > to) {
+            order--;
+        }
+        releasePlacement(placement, from, 1L << order);
+        from += 1L << order;
+    }
+}
+
+
+/**
+ * Creates a new Placement for a BlockTable whose blocks are all free.
+ *
+ * @param policy One of the POLICY_ constants.
+ * @param length Number of blocks in the BlockTable.
+ * @return A Placement ready to choose locations for new files.
+ */
+Placement createPlacement(int policy, long length) {
+    Placement p;
+    p.policy = policy;
+    p.rover = 0;
+    p.maxOrder = 0;
+    p.buddyFree = NULL;
+
+    if (policy == POLICY_BUDDY) {
+        p.buddyFree = malloc(sizeof(ExtentTree));
+        p.buddyFree[0] = createExtentTree(ORDER_BY_START);
+        setMaxOrder(&p, maxOrderFor(length));
+        freeBuddyRange(&p, 0, length);
+    }
+    return p;
+}
+
+
+/**
+ * Counts the blocks of [from, to) that lie in free buddy blocks of one order.
+ */
+static long countBuddyFree(ExtentTree* tree, long from, long to) {
+    long count = 0;
+    ExtentNode* node = findFloorExtent(tree, from);
+    if (node == NULL || node->start + node->length <= from) {
+        node = findCeilingExtent(tree, from);
+    }
+    for (; node != NULL && node->start < to; node = findCeilingExtent(tree, node->start + 1)) {
+        long start = node->start > from ? node->start : from;
+        long end = node->start + node->length < to ? node->start + node->length : to;
+        count += end - start;
+    }
+    return count;
+}
+
+
+/**
+ * Follows a BlockTable that grew or shrank. The roving pointer is moved back to the start if
+ * it is past the new end. The buddy policy gives blocks added at the end to its free lists,
+ * merging them with free buddies, and takes blocks removed at the end off of them, splitting the
+ * free block that straddles the new end. Blocks are only ever removed from the end of the table,
+ * and only if they are free in the buddy lists too: a file rounded up to a power of two holds
+ * blocks the BlockTable sees as free.
+ *
+ * @param placement The Placement to be resized.
+ * @param oldLength Number of blocks the BlockTable held.
+ * @param newLength Number of blocks the BlockTable holds now.
+ * @return 0 if the Placement was resized, -1 if a block past newLength is held by the buddy policy.
+ */
+int resizePlacement(Placement* placement, long oldLength, long newLength) {
+    int order;
+    if (placement->policy == POLICY_BUDDY && newLength < oldLength) {
+        long freeBlocks = 0;
+        for (order = 0; order <= placement->maxOrder; order++) {
+            freeBlocks += countBuddyFree(&placement->buddyFree[order], newLength, oldLength);
+        }
+        if (freeBlocks != oldLength - newLength) {
+            return -1;
+        }
+        long straddleStart = newLength;
+        for (order = 0; order <= placement->maxOrder; order++) {
+            ExtentTree* tree = &placement->buddyFree[order];
+            ExtentNode* node = findFloorExtent(tree, newLength);
+            if (node == NULL || node->start + node->length <= newLength) {
+                node = findCeilingExtent(tree, newLength);
+            }
+            while (node != NULL) {  // Everything from here on lies past the new end.
+                if (node->start < newLength) {
+                    straddleStart = node->start;
+                }
+                long start = node->start;
+                removeExtent(tree, start, node->length);
+                node = findCeilingExtent(tree, start);
+            }
+        }
+        setMaxOrder(placement, maxOrderFor(newLength));
+        freeBuddyRange(placement, straddleStart, newLength);
+    } else if (placement->policy == POLICY_BUDDY && newLength > oldLength) {
+        setMaxOrder(placement, maxOrderFor(newLength));
+        freeBuddyRange(placement, oldLength, newLength);
+    }
+    if (placement->rover >= newLength) {
+        placement->rover = 0;
+    }
+    return 0;
+}
+
+
+/**
+ * Frees all dynamically allocated memory held by a Placement.
+ *
+ * @param placement The Placement to be destroyed.
+ */
+void destroyPlacement(Placement* placement) {
+    int order;
+    if (placement->buddyFree != NULL) {
+        for (order = 0; order <= placement->maxOrder; order++) {
+            destroyExtentTree(&placement->buddyFree[order]);
+        }
+        free(placement->buddyFree);
+        placement->buddyFree = NULL;
+    }
+}
+
+
+/**
+ * Converts a policy name, as given on the command line, to its POLICY_ constant.
+ *
+ * @param name One of "first", "next", "best", "worst", "buddy" or "scan".
+ * @return The matching POLICY_ constant, or -1 if the name is not recognized.
+ */
+int parsePolicy(const char* name) {
+    int policy;
+    for (policy = 0; policy < POLICY_COUNT; policy++) {
+        if (strcmp(name, policyNames[policy]) == 0) {
+            return policy;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * Gives the command line name of a policy.
+ *
+ * @param policy One of the POLICY_ constants.
+ * @return The name of the policy.
+ */
+const char* policyName(int policy) {
+    return policyNames[policy];
+}
+
+
+/**
+ * Next-fit search: the first run long enough at or after the roving pointer, wrapping around
+ * to the start of the table if nothing after the pointer fits.
+ */
+static long nextFit(Placement* placement, FreeIndex* index, long blocksNeeded) {
+    long rover = placement->rover;
+    ExtentNode* node = findFloorExtent(&index->byStart, rover);
+    COUNT_SCAN(extentsExamined, 1);
+    if (node != NULL && node->start + node->length - rover >= blocksNeeded) {
+        return rover;  // The free run the pointer sits in still has room.
+    }
+    node = findFirstFitExtent(&index->byStart, rover, blocksNeeded);
+    if (node == NULL) {
+        node = findFirstFitExtent(&index->byStart, 0, blocksNeeded);
+    }
+    return node == NULL ? -1 : node->start;
+}
+
+
+/**
+ * Buddy search: takes the lowest free block of the smallest order that holds the request,
+ * splitting larger blocks down to that order as needed.
+ */
+static long buddyAllocate(Placement* placement, long blocksNeeded) {
+    int wanted = orderFor(blocksNeeded);
+    int order = wanted;
+    while (order <= placement->maxOrder && placement->buddyFree[order].count == 0) {
+        order++;
+    }
+    COUNT_SCAN(extentsExamined, order - wanted + 1);  // One free list looked at per order.
+    if (order > placement->maxOrder) {
+        return -1;
+    }
+
+    ExtentNode* node = findFirstExtent(&placement->buddyFree[order]);
+    long start = node->start;
+    removeExtent(&placement->buddyFree[order], start, node->length);
+    while (order > wanted) {  // Split, keeping the lower half and freeing the upper buddy.
+        order--;
+        insertExtent(&placement->buddyFree[order], start + (1L << order), 1L << order);
+    }
+    return start;
+}
+
+
+/**
+ * Chooses where a new file is stored. For every policy except buddy this only searches the
+ * BlockTable's FreeIndex, and the caller is expected to mark the blocks used with updateTable().
+ * The buddy policy also takes the chosen block off of its own free lists.
+ *
+ * @param placement The Placement making the decision.
+ * @param bTable The BlockTable the file will be stored in.
+ * @param blocksNeeded Number of contiguous blocks the file needs.
+ * @return The index of the first block for the file, or -1 if the policy cannot fit it.
+ */
+long choosePlacement(Placement* placement, BlockTable* bTable, long blocksNeeded) {
+    FreeIndex* index = &bTable->freeIndex;
+    ExtentNode* node;
+    long start = -1;
+    long costBefore = SCAN_COST();
+
+    switch (placement->policy) {
+        case POLICY_FIRST_FIT:
+            start = findFirstFit(index, blocksNeeded);
+            break;
+        case POLICY_NEXT_FIT:
+            start = nextFit(placement, index, blocksNeeded);
+            if (start >= 0) {
+                placement->rover = start + blocksNeeded;
+                if (placement->rover >= bTable->length) {
+                    placement->rover = 0;
+                }
+            }
+            break;
+        case POLICY_BEST_FIT:
+            node = findBestFitExtent(&index->byLength, blocksNeeded);
+            start = node == NULL ? -1 : node->start;
+            break;
+        case POLICY_WORST_FIT:
+            node = findLastExtent(&index->byLength);
+            COUNT_SCAN(extentsExamined, 1);
+            start = (node == NULL || node->length < blocksNeeded) ? -1 : node->start;
+            break;
+        case POLICY_BUDDY:
+            start = buddyAllocate(placement, blocksNeeded);
+            break;
+        case POLICY_SCAN:
+            if (bTable->inUse == NULL) {  // No bitmap to scan, the index gives the same answer.
+                start = findFirstFit(index, blocksNeeded);
+            } else {
+                start = findClearRun(bTable->inUse, bTable->length, 0, blocksNeeded);
+            }
+            break;
+    }
+    COUNT_SEARCH(start, costBefore);
+    return start;
+}
+
+
+/**
+ * Tells a Placement that a file's blocks have been freed. Only the buddy policy keeps state
+ * about allocated blocks, it returns the block to its free lists and merges free buddies.
+ *
+ * @param placement The Placement being updated.
+ * @param start Index of the first block of the deleted file.
+ * @param blocks Number of blocks the deleted file used.
+ */
+void releasePlacement(Placement* placement, long start, long blocks) {
+    if (placement->policy != POLICY_BUDDY) {
+        return;
+    }
+
+    int order = orderFor(blocks);
+    while (order < placement->maxOrder) {
+        long buddy = start ^ (1L << order);
+        ExtentNode* node = findFloorExtent(&placement->buddyFree[order], buddy);
+        if (node == NULL || node->start != buddy) {
+            break;  // Buddy is in use or split, stop merging.
+        }
+        removeExtent(&placement->buddyFree[order], buddy, node->length);
+        if (buddy < start) {
+            start = buddy;
+        }
+        order++;
+    }
+    insertExtent(&placement->buddyFree[order], start, 1L << order);
+}
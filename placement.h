@@ -0,0 +1,45 @@
+//
+// placement.h
+//
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include "blockTable.h"
+#include "extentTree.h"
+
+typedef struct placement Placement;
+
+/* Placement policies a MemorySystem can be created with. */
+#define POLICY_FIRST_FIT 0
+#define POLICY_NEXT_FIT 1
+#define POLICY_BEST_FIT 2
+#define POLICY_WORST_FIT 3
+#define POLICY_BUDDY 4
+#define POLICY_SCAN 5
+#define POLICY_COUNT 6
+
+/**
+ * Definition of the Placement type. Decides where in a BlockTable a new file is stored.
+ * First-fit, next-fit, best-fit and worst-fit all search the table's FreeIndex. The buddy
+ * policy keeps its own free lists, one start ordered ExtentTree per power-of-two order, and
+ * rounds every allocation up to a power-of-two number of blocks. The scan policy is first-fit
+ * without the index, searching the BlockTable's occupancy bitmap a word at a time instead. Tables
+ * using the TABLE_EXTENTS backend have no bitmap, so for them scan falls back to the index.
+ */
+struct placement {
+    int policy;
+    long rover;
+    int maxOrder;
+    ExtentTree* buddyFree;
+};
+
+Placement createPlacement(int policy, long length);
+void destroyPlacement(Placement* placement);
+int parsePolicy(const char* name);
+const char* policyName(int policy);
+long choosePlacement(Placement* placement, BlockTable* bTable, long blocksNeeded);
+void releasePlacement(Placement* placement, long start, long blocks);
+int resizePlacement(Placement* placement, long oldLength, long newLength);
+
+#endif
@@ -0,0 +1,51 @@
+//
+// scanStats.c
+//
+
+#include "scanStats.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef SCAN_STATS
+__thread ScanStats scanStats;
+
+
+/**
+ * Average of a counter over a number of calls, 0 when there were none.
+ */
+static double perCall(long total, long calls) {
+    return calls > 0 ? (double) total / calls : 0;
+}
+#endif
+
+
+/**
+ * Sets every counter of the calling thread back to zero.
+ */
+void resetScanStats(void) {
+#ifdef SCAN_STATS
+    memset(&scanStats, 0, sizeof(scanStats));
+#endif
+}
+
+
+/**
+ * Prints the counters of the calling thread, with the average work per call. Prints a note
+ * instead if the program was built without SCAN_STATS.
+ */
+void printScanStats(void) {
+#ifdef SCAN_STATS
+    ScanStats* s = &scanStats;
+    printf("Placement searches:\t%ld\n", s->searches);
+    printf("Extents examined:\t%ld (%.2f per search)\n", s->extentsExamined, perCall(s->extentsExamined, s->searches));
+    printf("Bitmap words examined:\t%ld (%.2f per search)\n", s->wordsExamined, perCall(s->wordsExamined, s->searches));
+    printf("Failed searches:\t%ld (%.2f extents and words each)\n", s->failedSearches, perCall(s->failedCost, s->failedSearches));
+    printf("Directory lookups:\t%ld\n", s->lookups);
+    printf("Name comparisons:\t%ld (%.2f per lookup)\n", s->comparisons, perCall(s->comparisons, s->lookups));
+    printf("Directory deletes:\t%ld\n", s->deletes);
+    printf("Hash slots moved:\t%ld (%ld bytes, %.2f bytes per delete)\n", s->slotsMoved, s->bytesMoved,
+           perCall(s->bytesMoved, s->deletes));
+#else
+    printf("Scan statistics are not compiled in, rebuild with make SCAN_STATS=1.\n");
+#endif
+}
@@ -0,0 +1,51 @@
+//
+// scanStats.h
+//
+
+#ifndef SCAN_STATS_H
+#define SCAN_STATS_H
+
+typedef struct scanStats ScanStats;
+
+/**
+ * Definition of the ScanStats type. Counts the work done by the searches on the hot paths of the
+ * system: every placement search (choosePlacement() and checkForSpace()), with the free extents
+ * and buddy free lists it looked at and the bitmap words it scanned, and the same work again for
+ * the searches that found no space; every findEntryInDirectory() call with the names it compared;
+ * and every deleteFromDirectory() call with the hash slots, and bytes, it shifted back.
+ */
+struct scanStats {
+    long searches;
+    long extentsExamined;
+    long wordsExamined;
+    long failedSearches;
+    long failedCost;
+    long lookups;
+    long comparisons;
+    long deletes;
+    long slotsMoved;
+    long bytesMoved;
+};
+
+/*
+ * The counters are only compiled in when SCAN_STATS is defined, "make SCAN_STATS=1" builds with
+ * them. Otherwise every COUNT_SCAN() expands to nothing and its arguments are never evaluated, so
+ * the instrumented code is the same as without it. The counters are per thread, so threads never
+ * share a cache line through them, and the report covers the thread it is printed from.
+ */
+#ifdef SCAN_STATS
+extern __thread ScanStats scanStats;
+#define COUNT_SCAN(counter, amount) (scanStats.counter += (amount))
+#define SCAN_COST() (scanStats.extentsExamined + scanStats.wordsExamined)
+#define COUNT_SEARCH(start, costBefore) \
+    (scanStats.searches++, (start) < 0 ? (scanStats.failedSearches++, scanStats.failedCost += SCAN_COST() - (costBefore)) : 0)
+#else
+#define COUNT_SCAN(counter, amount) ((void) 0)
+#define SCAN_COST() 0L
+#define COUNT_SEARCH(start, costBefore) ((void) (costBefore))
+#endif
+
+void resetScanStats(void);
+void printScanStats(void);
+
+#endif
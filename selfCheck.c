@@ -0,0 +1,201 @@
+//
+// selfCheck.c
+//
+// Checks that the two BlockTable backends, and a snapshot save and restore, agree on where every
+// file ends up. For every placement policy a trace is replayed against a TABLE_BLOCKS and a
+// TABLE_EXTENTS system. Halfway through, the first is saved as a snapshot and restored into one
+// system of each backend, and the rest of the trace is replayed against all four. After the
+// restore and at the end, every system is exported as csv (see export.c) and the exports must be
+// identical, and every file must be found under its own name in its system's Directory. Any
+// difference means one of the free index, bitmap search, Directory hash or handles, extent
+// backend or snapshot code has drifted from the others.
+//
+
+#include "selfCheck.h"
+#include "snapshot.h"
+#include "export.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char* checkSystemNames[CHECK_SYSTEMS] = {"blocks", "extents", "restored blocks", "restored extents"};
+
+
+/**
+ * Replays the operations from..to-1 of a trace against one system, the way a batch replay does.
+ */
+static void replayOperations(MemorySystem* system, Trace* trace, long from, long to) {
+    long i;
+    for (i = from; i < to; i++) {
+        Operation* op = trace->ops + i;
+        if (op->type == OP_ADD) {
+            addFileToSystem(system, operationName(trace, op), op->size);
+        } else if (op->type == OP_DELETE) {
+            deleteFileFromSystem(system, operationName(trace, op));
+        } else if (op->type == OP_RESIZE) {
+            resizeSystem(system, op->size);
+        }
+        stepCompaction(system);
+    }
+}
+
+
+/**
+ * Exports a whole system as csv into memory.
+ *
+ * @return The export, which the caller frees, or NULL if it could not be written.
+ */
+static char* exportToMemory(MemorySystem* system, size_t* size) {
+    char* data = NULL;
+    FILE* out = open_memstream(&data, size);
+    if (out == NULL) {
+        return NULL;
+    }
+    int result = exportSystem(system, out, EXPORT_CSV, 0, -1);
+    fclose(out);
+    if (result != 0) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+
+/**
+ * Counts the files of a system that findEntryInDirectory() does not find under their own name,
+ * or finds at another handle.
+ */
+static long countLostFiles(MemorySystem* system) {
+    Directory* d = &system->directory;
+    ExtentNode* node;
+    long lost = d->size - d->extents.count;
+    for (node = findFirstExtent(&d->extents); node != NULL; node = findCeilingExtent(&d->extents, node->start + 1)) {
+        if (findEntryInDirectory(d, d->list[node->owner].fileName) != node->owner) {
+            lost++;
+        }
+    }
+    return lost;
+}
+
+
+/**
+ * Compares the exports of every system with that of the first, printing every difference.
+ *
+ * @return 0 if all of them match and every file is found by name, -1 otherwise.
+ */
+static int compareSystems(MemorySystem* systems, const char* stage) {
+    char* exports[CHECK_SYSTEMS];
+    size_t sizes[CHECK_SYSTEMS];
+    int result = 0;
+    int i;
+    for (i = 0; i < CHECK_SYSTEMS; i++) {
+        exports[i] = exportToMemory(&systems[i], &sizes[i]);
+        long lost = countLostFiles(&systems[i]);
+        if (exports[i] == NULL) {
+            printf("    %s could not be exported %s\n", checkSystemNames[i], stage);
+            result = -1;
+        } else if (i > 0 && exports[0] != NULL
+                   && (sizes[i] != sizes[0] || memcmp(exports[i], exports[0], sizes[0]) != 0)) {
+            printf("    %s differs from %s %s\n", checkSystemNames[i], checkSystemNames[0], stage);
+            result = -1;
+        }
+        if (lost > 0) {
+            printf("    %s has %ld files its Directory does not find by name %s\n", checkSystemNames[i], lost, stage);
+            result = -1;
+        }
+    }
+    for (i = 0; i < CHECK_SYSTEMS; i++) {
+        free(exports[i]);
+    }
+    return result;
+}
+
+
+/**
+ * Runs the self-check for one placement policy, see the top of this file.
+ *
+ * @return 0 if every system agreed, 1 if the policy cannot be checked with this compaction
+ *         setting, -1 if the systems disagreed or a snapshot could not be saved or restored.
+ */
+static int checkPolicy(Trace* trace, int policy, int compactMode, long compactStep) {
+    MemorySystem systems[CHECK_SYSTEMS];
+    char path[] = "/tmp/selfCheck-XXXXXX";
+    long half = trace->count / 2;
+    int result = 0;
+    int i, restored = 0;
+
+    for (i = 0; i < 2; i++) {
+        systems[i] = createMemorySystem(trace->systemSize, trace->blockSize, policy, i == 0 ? TABLE_BLOCKS : TABLE_EXTENTS);
+    }
+    if (setCompaction(&systems[0], compactMode, compactStep) != 0) {
+        destroyMemorySystem(&systems[0]);
+        destroyMemorySystem(&systems[1]);
+        return 1;
+    }
+    setCompaction(&systems[1], compactMode, compactStep);
+    replayOperations(&systems[0], trace, 0, half);
+    replayOperations(&systems[1], trace, 0, half);
+
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("    Could not create a temporary snapshot file.\n");
+        result = -1;
+    } else {
+        close(fd);
+        if (saveSnapshot(&systems[0], path) == 0) {
+            for (restored = 0; restored < 2; restored++) {
+                if (loadSnapshot(&systems[2 + restored], path, policy, restored == 0 ? TABLE_BLOCKS : TABLE_EXTENTS) != 0) {
+                    break;
+                }
+                setCompaction(&systems[2 + restored], compactMode, compactStep);
+            }
+        }
+        unlink(path);
+        result = restored == 2 ? 0 : -1;
+    }
+
+    if (result == 0) {
+        result = compareSystems(systems, "after the restore");
+        for (i = 0; i < CHECK_SYSTEMS; i++) {
+            replayOperations(&systems[i], trace, half, trace->count);
+        }
+        result |= compareSystems(systems, "at the end");
+    }
+    for (i = 0; i < 2 + restored; i++) {
+        destroyMemorySystem(&systems[i]);
+    }
+    return result;
+}
+
+
+/**
+ * Replays a trace against both backends and through a snapshot, for one placement policy or for
+ * all of them, and reports whether every system ended up the same, see the top of this file.
+ *
+ * @param trace The operations to be replayed, which are only read.
+ * @param policy The POLICY_ constant of the placement policy to check, or -1 for every policy.
+ * @param compactMode The COMPACT_ constant every system is configured with.
+ * @param compactStep Most blocks moved by one incremental compaction step.
+ * @return 0 if every policy checked passed, -1 if any failed or the trace's sizes are invalid.
+ */
+int runSelfCheck(Trace* trace, int policy, int compactMode, long compactStep) {
+    int failed = 0, checked = 0;
+    int p;
+    if (checkSystemSize(trace->systemSize, trace->blockSize) != 0) {
+        return -1;
+    }
+    for (p = policy < 0 ? 0 : policy; p < (policy < 0 ? POLICY_COUNT : policy + 1); p++) {
+        int result = checkPolicy(trace, p, compactMode, compactStep);
+        if (result > 0) {
+            printf("%-8sskipped, compaction cannot be used with this policy\n", policyName(p));
+            continue;
+        }
+        printf("%-8s%s\n", policyName(p), result == 0 ? "ok" : "FAILED");
+        failed += result != 0;
+        checked++;
+    }
+    printf("Self-check %s: %d of %d policies agree across backends and snapshots.\n", failed == 0 ? "passed" : "failed",
+           checked - failed, checked);
+    return failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,17 @@
+//
+// selfCheck.h
+//
+
+#ifndef SELF_CHECK_H
+#define SELF_CHECK_H
+
+#include "memorySystem.h"
+#include "trace.h"
+
+/* Systems a self-check replays every policy against: both backends, and both again as restored
+ * from a snapshot of the first taken halfway through the trace. */
+#define CHECK_SYSTEMS 4
+
+int runSelfCheck(Trace* trace, int policy, int compactMode, long compactStep);
+
+#endif
@@ -0,0 +1,468 @@
+//
+// server.c
+//
+// Serves a MemorySystem to local clients over a Unix domain socket. Requests and replies are
+// lines of text, words separated by spaces:
+//
+//     add <name> <size>    ok <start> <length>, or err no_space, err duplicate
+//     delete <name>        ok, or err not_found
+//     lookup <name>        ok <size> <start> <length>, or err not_found
+//     owner <block>        ok <name> <size> <start> <length> of the file in the block, or
+//                             err not_found if the block is free or outside the table
+//     range <from> <to>    ok <count>, then one <name> <size> <start> <length> line for every
+//                             file with a block in [from, to), in block order
+//     stats                ok files=<n> used_bytes=<n> fragmented_bytes=<n> blocks_in_use=<n>
+//                             free_blocks=<n> free_extents=<n> largest_free_extent=<n>
+//     quit                 ok, then the server closes the connection
+//     shutdown             ok, then the server stops
+//
+// Any other line is answered with err invalid, and blank lines are ignored. Every request gets
+// exactly one reply, a single line for every request but range, in the order the requests were
+// sent, so a client may send any number of requests before reading the replies. Every request
+// already read from a client is handled before the replies are written back in one write.
+// Replies a client has not taken yet are kept for it, and once SERVER_MAX_PENDING bytes of them
+// wait, no more requests are read from it until it takes some. A client that is done sending may
+// shut down its side of the socket and still read every reply.
+//
+
+#define _GNU_SOURCE  // For accept4().
+#include "server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* Most events handled per epoll_wait() call, and the most files of a range request listed
+ * without allocating. */
+#define SERVER_EVENTS 64
+#define SERVER_RANGE_FILES 256
+
+/* Set by SIGINT and SIGTERM to stop the server. */
+static volatile sig_atomic_t stopRequested = 0;
+
+
+/**
+ * Signal handler that asks the server to stop once epoll_wait() returns.
+ */
+static void requestStop(int signalNumber) {
+    (void) signalNumber;
+    stopRequested = 1;
+}
+
+
+/**
+ * Appends a printf formatted reply of at most SERVER_MAX_REPLY bytes, and its newline, to the
+ * replies of a connection, making room for it first.
+ */
+static void reply(Connection* c, const char* format, ...) {
+    va_list arguments;
+    if (c->outCapacity - c->outUsed < SERVER_MAX_REPLY) {
+        if (c->outSent > 0) {  // Drop what has been written before growing.
+            memmove(c->out, c->out + c->outSent, c->outUsed - c->outSent);
+            c->outUsed -= c->outSent;
+            c->outSent = 0;
+        }
+        if (c->outCapacity - c->outUsed < SERVER_MAX_REPLY) {
+            c->outCapacity *= 2;
+            c->out = realloc(c->out, c->outCapacity);
+        }
+    }
+    va_start(arguments, format);
+    int written = vsnprintf(c->out + c->outUsed, SERVER_MAX_REPLY - 1, format, arguments);
+    va_end(arguments);
+    c->outUsed += written < SERVER_MAX_REPLY - 1 ? written : SERVER_MAX_REPLY - 2;
+    c->out[c->outUsed++] = '\n';
+}
+
+
+/**
+ * Parses the size of an add request.
+ *
+ * @return The size, or -1 if the text is not a positive number.
+ */
+static long parseFileSize(const char* text) {
+    char* endPointer;
+    errno = 0;
+    long size = strtol(text, &endPointer, 10);
+    if (*endPointer != '\0' || endPointer == text || size <= 0 || errno == ERANGE) {
+        return -1;
+    }
+    return size;
+}
+
+
+/**
+ * Parses a block index of an owner or range request.
+ *
+ * @return The index, or -1 if the text is not a number of zero or more.
+ */
+static long parseBlock(const char* text) {
+    char* endPointer;
+    errno = 0;
+    long block = strtol(text, &endPointer, 10);
+    if (*endPointer != '\0' || endPointer == text || block < 0 || errno == ERANGE) {
+        return -1;
+    }
+    return block;
+}
+
+
+/**
+ * Appends the reply to a range request, the count line and a line per file, to the connection.
+ */
+static void replyRange(Directory* d, Connection* c, long from, long to) {
+    long found[SERVER_RANGE_FILES];
+    long* handles = found;
+    long i;
+    long count = findEntriesInRange(d, from, to, handles, SERVER_RANGE_FILES);
+    if (count > SERVER_RANGE_FILES) {
+        handles = malloc(sizeof(long) * count);
+        findEntriesInRange(d, from, to, handles, count);
+    }
+    reply(c, "ok %ld", count);
+    for (i = 0; i < count; i++) {
+        Entry* e = &d->list[handles[i]];
+        reply(c, "%s %ld %ld %ld", e->fileName, e->size, e->start, e->length);
+    }
+    if (handles != found) {
+        free(handles);
+    }
+}
+
+
+/**
+ * Handles one request line, see the top of this file, and appends its reply to the connection.
+ */
+static void handleRequest(Server* server, Connection* c, char* line) {
+    MemorySystem* system = server->system;
+    char* saved;
+    char* command = strtok_r(line, " \t\r", &saved);
+    char* name = strtok_r(NULL, " \t\r", &saved);
+    char* sizeText = name != NULL ? strtok_r(NULL, " \t\r", &saved) : NULL;
+    char* extra = sizeText != NULL ? strtok_r(NULL, " \t\r", &saved) : NULL;
+    if (command == NULL) {
+        return;
+    }
+    server->requests++;
+
+    if (extra != NULL || (name != NULL && strlen(name) >= MAX_FILE_NAME)) {
+        reply(c, "err invalid");
+    } else if (strcmp(command, "add") == 0 && sizeText != NULL) {
+        long size = parseFileSize(sizeText);
+        if (size < 0) {
+            reply(c, "err invalid");
+        } else {
+            switch (addFileToSystem(system, name, size)) {
+                case SYSTEM_OK: {
+                    Entry* e = &system->directory.list[findEntryInDirectory(&system->directory, name)];
+                    reply(c, "ok %ld %ld", e->start, e->length);
+                    break;
+                }
+                case SYSTEM_DUPLICATE:
+                    reply(c, "err duplicate");
+                    break;
+                case SYSTEM_BAD_NAME:
+                    reply(c, "err invalid");
+                    break;
+                default:
+                    reply(c, "err no_space");
+            }
+        }
+    } else if (strcmp(command, "delete") == 0 && name != NULL && sizeText == NULL) {
+        reply(c, deleteFileFromSystem(system, name) == SYSTEM_OK ? "ok" : "err not_found");
+    } else if (strcmp(command, "lookup") == 0 && name != NULL && sizeText == NULL) {
+        long handle = findEntryInDirectory(&system->directory, name);
+        if (handle < 0) {
+            reply(c, "err not_found");
+        } else {
+            Entry* e = &system->directory.list[handle];
+            reply(c, "ok %ld %ld %ld", e->size, e->start, e->length);
+        }
+    } else if (strcmp(command, "owner") == 0 && name != NULL && sizeText == NULL && parseBlock(name) >= 0) {
+        long handle = findEntryAtBlock(&system->directory, parseBlock(name));
+        if (handle < 0) {
+            reply(c, "err not_found");
+        } else {
+            Entry* e = &system->directory.list[handle];
+            reply(c, "ok %s %ld %ld %ld", e->fileName, e->size, e->start, e->length);
+        }
+    } else if (strcmp(command, "range") == 0 && sizeText != NULL && parseBlock(name) >= 0
+               && parseBlock(sizeText) > parseBlock(name)) {
+        replyRange(&system->directory, c, parseBlock(name), parseBlock(sizeText));
+    } else if (strcmp(command, "stats") == 0 && name == NULL) {
+        TableMetrics m = getTableMetrics(&system->table);
+        reply(c, "ok files=%ld used_bytes=%ld fragmented_bytes=%ld blocks_in_use=%ld free_blocks=%ld "
+                 "free_extents=%ld largest_free_extent=%ld", system->directory.size, m.usedBytes,
+              m.fragmentedBytes, m.blocksInUse, m.freeBlocks, m.freeExtents, m.largestFreeExtent);
+    } else if (strcmp(command, "quit") == 0 && name == NULL) {
+        reply(c, "ok");
+        c->closing = 1;
+    } else if (strcmp(command, "shutdown") == 0 && name == NULL) {
+        reply(c, "ok");
+        server->running = 0;
+    } else {
+        reply(c, "err invalid");
+    }
+    stepCompaction(system);
+}
+
+
+/**
+ * Reads what a client has sent and handles every complete request line in it.
+ *
+ * @return 0 if the connection is still open, -1 if the client has closed its side or failed.
+ */
+static int readRequests(Server* server, Connection* c) {
+    ssize_t received = read(c->fd, c->in + c->inUsed, SERVER_READ_BUFFER - c->inUsed);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return 0;
+    } else if (received <= 0) {
+        if (received == 0 && c->inUsed > 0 && !c->closing) {  // The last request may lack its newline.
+            c->in[c->inUsed] = '\0';
+            handleRequest(server, c, c->in);
+            c->inUsed = 0;
+        }
+        return -1;
+    }
+    c->inUsed += received;
+
+    char* line = c->in;
+    char* end = c->in + c->inUsed;
+    char* newline;
+    while (!c->closing && (newline = memchr(line, '\n', end - line)) != NULL) {
+        *newline = '\0';
+        handleRequest(server, c, line);
+        line = newline + 1;
+    }
+    c->inUsed = c->closing ? 0 : end - line;
+    memmove(c->in, line, c->inUsed);
+    if (c->inUsed == SERVER_READ_BUFFER) {  // A whole buffer without a newline cannot be a request.
+        reply(c, "err invalid");
+        c->inUsed = 0;
+        c->closing = 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Writes as many of a connection's replies as the client will take.
+ *
+ * @return 0 if every reply has been written, 1 if some are still waiting, -1 if the write failed.
+ */
+static int writeReplies(Connection* c) {
+    while (c->outSent < c->outUsed) {
+        ssize_t sent = send(c->fd, c->out + c->outSent, c->outUsed - c->outSent, MSG_NOSIGNAL);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 1;
+        } else if (sent < 0 && errno != EINTR) {
+            return -1;
+        } else if (sent > 0) {
+            c->outSent += sent;
+        }
+    }
+    c->outUsed = 0;
+    c->outSent = 0;
+    return 0;
+}
+
+
+/**
+ * Closes a connection and frees everything it holds.
+ */
+static void closeConnection(Server* server, Connection* c) {
+    epoll_ctl(server->epollFd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    if (c->previous != NULL) {
+        c->previous->next = c->next;
+    } else {
+        server->connections = c->next;
+    }
+    if (c->next != NULL) {
+        c->next->previous = c->previous;
+    }
+    free(c->in);
+    free(c->out);
+    free(c);
+}
+
+
+/**
+ * Handles the events epoll reported for a connection: reads and handles requests unless too many
+ * replies are waiting already, then writes the replies back. While some are still waiting the
+ * connection is also watched for the client taking more of them.
+ */
+static void serveConnection(Server* server, Connection* c, uint32_t events) {
+    if (c->outUsed - c->outSent < SERVER_MAX_PENDING && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        && readRequests(server, c) != 0) {
+        c->closing = 1;
+    }
+    int result = writeReplies(c);
+    if (result < 0 || (result == 0 && c->closing)) {
+        closeConnection(server, c);
+        return;
+    }
+    uint32_t watch = result == 0 ? EPOLLIN
+                     : c->closing || c->outUsed - c->outSent >= SERVER_MAX_PENDING ? EPOLLOUT : EPOLLIN | EPOLLOUT;
+    if (watch != c->watching) {
+        struct epoll_event event;
+        c->watching = watch;
+        event.events = watch;
+        event.data.ptr = c;
+        epoll_ctl(server->epollFd, EPOLL_CTL_MOD, c->fd, &event);
+    }
+}
+
+
+/**
+ * Accepts every client waiting on the listening socket.
+ */
+static void acceptClients(Server* server) {
+    int fd;
+    while ((fd = accept4(server->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        Connection* c = calloc(1, sizeof(Connection));
+        struct epoll_event event;
+        c->fd = fd;
+        c->in = malloc(SERVER_READ_BUFFER + 1);  // Room to end a last request that lacks its newline.
+        c->outCapacity = SERVER_READ_BUFFER;
+        c->out = malloc(c->outCapacity);
+        c->next = server->connections;
+        if (c->next != NULL) {
+            c->next->previous = c;
+        }
+        server->connections = c;
+        c->watching = EPOLLIN;
+        event.events = EPOLLIN;
+        event.data.ptr = c;
+        epoll_ctl(server->epollFd, EPOLL_CTL_ADD, fd, &event);
+        server->clients++;
+    }
+}
+
+
+/**
+ * Creates the listening socket at the server's path, replacing a socket left there by an earlier
+ * run, and the epoll instance watching it.
+ *
+ * @return 0 if the server is listening, -1 otherwise.
+ */
+static int startListening(Server* server) {
+    struct sockaddr_un address;
+    struct stat existing;
+    struct epoll_event event;
+    if (strlen(server->path) >= sizeof(address.sun_path)) {
+        printf("Socket path is too long: %s\n", server->path);
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, server->path);
+    if (stat(server->path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(server->path);
+    }
+
+    server->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    server->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->listenFd < 0 || server->epollFd < 0
+        || bind(server->listenFd, (struct sockaddr*) &address, sizeof(address)) != 0
+        || listen(server->listenFd, SOMAXCONN) != 0) {
+        printf("Could not listen on %s: %s\n", server->path, strerror(errno));
+        return -1;
+    }
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;  // The only event without a Connection.
+    return epoll_ctl(server->epollFd, EPOLL_CTL_ADD, server->listenFd, &event);
+}
+
+
+/**
+ * Serves a MemorySystem on a Unix domain socket, see the top of this file, until a client sends
+ * shutdown or the process gets SIGINT or SIGTERM. Every client shares the one system, and
+ * requests are handled one at a time in the order they are read. Prints how many requests were
+ * served once the server stops.
+ *
+ * @param system The MemorySystem to be served.
+ * @param path Path of the socket, which is created, and removed again when the server stops.
+ * @return 0 if the server ran until it was stopped, -1 if it could not listen on the path or
+ *         waiting for clients failed.
+ */
+int runServer(MemorySystem* system, const char* path) {
+    struct epoll_event events[SERVER_EVENTS];
+    struct sigaction stop, oldInterrupt, oldTerminate;
+    struct timespec begin, end;
+    Server server;
+    int result = 0;
+    server.system = system;
+    server.path = path;
+    server.listenFd = -1;
+    server.epollFd = -1;
+    server.connections = NULL;
+    server.requests = 0;
+    server.clients = 0;
+    server.running = 1;
+
+    if (startListening(&server) != 0) {
+        if (server.listenFd >= 0) {
+            close(server.listenFd);
+        }
+        if (server.epollFd >= 0) {
+            close(server.epollFd);
+        }
+        return -1;
+    }
+    printf("Listening on %s\n", path);
+    fflush(stdout);
+
+    // No SA_RESTART, so that a signal wakes epoll_wait() up.
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = requestStop;
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, &oldInterrupt);
+    sigaction(SIGTERM, &stop, &oldTerminate);
+    stopRequested = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    while (server.running && !stopRequested) {
+        int count = epoll_wait(server.epollFd, events, SERVER_EVENTS, -1);
+        int i;
+        if (count < 0 && errno != EINTR) {
+            printf("Waiting for clients failed: %s\n", strerror(errno));
+            result = -1;
+            break;
+        }
+        for (i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL) {
+                acceptClients(&server);
+            } else {
+                serveConnection(&server, events[i].data.ptr, events[i].events);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    sigaction(SIGINT, &oldInterrupt, NULL);
+    sigaction(SIGTERM, &oldTerminate, NULL);
+
+    while (server.connections != NULL) {  // Hand back what replies the clients will take, then close.
+        writeReplies(server.connections);
+        closeConnection(&server, server.connections);
+    }
+    close(server.listenFd);
+    close(server.epollFd);
+    unlink(path);
+
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+    printf("Served %ld requests from %ld clients in %.3f seconds", server.requests, server.clients, seconds);
+    if (seconds > 0) {
+        printf(" (%.0f requests/sec)", server.requests / seconds);
+    }
+    printf("\n");
+    return result;
+}
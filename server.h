@@ -0,0 +1,61 @@
+//
+// server.h
+//
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include "memorySystem.h"
+
+typedef struct connection Connection;
+typedef struct server Server;
+
+/* Size of the buffer each connection's requests are read into, which also bounds the length of
+ * one request line, the most bytes one reply may take up, and the most bytes of replies kept for
+ * a client before its requests stop being read. */
+#define SERVER_READ_BUFFER (1 << 16)
+#define SERVER_MAX_REPLY 256
+#define SERVER_MAX_PENDING (1L << 24)
+
+/**
+ * Definition of the Connection type. One client of a Server. in holds bytes read from the
+ * client, of which inUsed are not yet handled because they do not end in a newline. out holds
+ * the replies not yet written back, outSent of its outUsed bytes have been. watching holds the
+ * epoll events the connection is registered for, which include EPOLLOUT while replies wait.
+ * closing is set once the connection is to be closed when out has been written. Every open
+ * connection is on its Server's list.
+ */
+struct connection {
+    int fd;
+    char* in;
+    long inUsed;
+    char* out;
+    long outUsed;
+    long outSent;
+    long outCapacity;
+    uint32_t watching;
+    int closing;
+    Connection* previous;
+    Connection* next;
+};
+
+/**
+ * Definition of the Server type. Serves one MemorySystem to any number of local clients over a
+ * Unix domain socket, from one thread driven by epoll. requests and clients count every request
+ * handled and every connection accepted. running is cleared by a shutdown request or a signal.
+ */
+struct server {
+    MemorySystem* system;
+    const char* path;
+    int listenFd;
+    int epollFd;
+    Connection* connections;
+    long requests;
+    long clients;
+    int running;
+};
+
+int runServer(MemorySystem* system, const char* path);
+
+#endif
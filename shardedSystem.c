@@ -0,0 +1,200 @@
+//
+// shardedSystem.c
+//
+
+#include "shardedSystem.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Number of entries each stripe's Directory has room for before it first grows. */
+#define STRIPE_START_LENGTH 256
+
+
+/**
+ * Finds the stripe a file name belongs to. Uses the high half of the hash, since the low bits
+ * already pick the slot inside the stripe's Directory.
+ */
+static NameStripe* stripeOf(ShardedSystem* system, const char* fileName) {
+    return &system->stripes[(hashName(fileName) >> 32) & (NAME_STRIPES - 1)];
+}
+
+
+/**
+ * Finds the shard holding the given device-wide block number.
+ */
+static Shard* shardOf(ShardedSystem* system, long block) {
+    long shard = block / system->shardBlocks;
+    return &system->shards[shard < system->shardCount ? shard : system->shardCount - 1];
+}
+
+
+/**
+ * Creates a new ShardedSystem with the device split evenly between the shards. The caller is
+ * responsible for checking the sizes with checkSystemSize() first. If the device has fewer
+ * blocks than shardCount, it is given one shard per block instead.
+ *
+ * @param systemSize Total size of the storage device.
+ * @param blockSize Size of each block on the storage device.
+ * @param shardCount Number of shards to split the device into, at least one.
+ * @param policy The POLICY_ constant of the placement policy used within every shard.
+ * @param backend The TABLE_ constant of the BlockTable backend of every shard.
+ * @return A ShardedSystem with every shard empty.
+ */
+ShardedSystem createShardedSystem(long systemSize, long blockSize, int shardCount, int policy, int backend) {
+    ShardedSystem system;
+    long blocks = systemSize / blockSize;
+    int i;
+    if (shardCount > blocks) {
+        shardCount = (int) blocks;
+    }
+    system.shardCount = shardCount;
+    system.shardBlocks = blocks / shardCount;
+    system.blockSize = blockSize;
+    system.shards = malloc(sizeof(Shard) * shardCount);
+    for (i = 0; i < shardCount; i++) {
+        Shard* shard = &system.shards[i];
+        long length = i < shardCount - 1 ? system.shardBlocks : blocks - i * system.shardBlocks;
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->system = createMemorySystem(length * blockSize, blockSize, policy, backend);
+        shard->firstBlock = i * system.shardBlocks;
+        shard->stolenAdds = 0;
+    }
+    for (i = 0; i < NAME_STRIPES; i++) {
+        pthread_mutex_init(&system.stripes[i].lock, NULL);
+        system.stripes[i].names = createDirectory(STRIPE_START_LENGTH);
+    }
+    return system;
+}
+
+
+/**
+ * Frees all dynamically allocated memory held by a ShardedSystem. No other thread may be
+ * using the system.
+ *
+ * @param system The ShardedSystem to be destroyed.
+ */
+void destroyShardedSystem(ShardedSystem* system) {
+    int i;
+    for (i = 0; i < system->shardCount; i++) {
+        pthread_mutex_destroy(&system->shards[i].lock);
+        destroyMemorySystem(&system->shards[i].system);
+    }
+    for (i = 0; i < NAME_STRIPES; i++) {
+        pthread_mutex_destroy(&system->stripes[i].lock);
+        destroyDirectory(&system->stripes[i].names);
+    }
+    free(system->shards);
+    system->shards = NULL;
+}
+
+
+/**
+ * Stores a new file in the system. Safe to call from any number of threads at once. The file
+ * goes to homeShard if it has room, otherwise the following shards are tried in turn, so an add
+ * only fails when no single shard has enough contiguous free blocks.
+ *
+ * @param system The ShardedSystem the file is added to.
+ * @param homeShard The shard the calling thread tries first, usually one per thread.
+ * @param fileName Name of the new file.
+ * @param fileSize Size of the new file, must be greater than zero.
+ * @return SYSTEM_OK if the file was added, SYSTEM_NO_SPACE if there is not enough contiguous memory
+ *         in any shard, SYSTEM_DUPLICATE if a file with the same name is already stored,
+ *         SYSTEM_BAD_NAME if the name is MAX_FILE_NAME bytes or longer.
+ */
+int addFileToShards(ShardedSystem* system, int homeShard, char* fileName, long fileSize) {
+    NameStripe* stripe = stripeOf(system, fileName);
+    int result = SYSTEM_NO_SPACE;
+    int i;
+    if (strlen(fileName) >= MAX_FILE_NAME) {
+        return SYSTEM_BAD_NAME;
+    }
+
+    // Holding the stripe for the whole add keeps a second add of the same name from racing this one.
+    pthread_mutex_lock(&stripe->lock);
+    if (findEntryInDirectory(&stripe->names, fileName) >= 0) {
+        pthread_mutex_unlock(&stripe->lock);
+        return SYSTEM_DUPLICATE;
+    }
+
+    for (i = 0; i < system->shardCount && result != SYSTEM_OK; i++) {
+        Shard* shard = &system->shards[(homeShard + i) % system->shardCount];
+        pthread_mutex_lock(&shard->lock);
+        MemorySystem* local = &shard->system;
+        if (local->table.freeIndex.freeBlocks >= blocksForSize(&local->table, fileSize)) {
+            result = addFileToSystem(local, fileName, fileSize);
+        }
+        if (result == SYSTEM_OK) {
+            Entry* e = &local->directory.list[findEntryInDirectory(&local->directory, fileName)];
+            addToDirectory(&stripe->names, createEntry(fileName, fileSize, shard->firstBlock + e->start, e->length));
+            if (i > 0) {
+                shard->stolenAdds++;
+            }
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    return result;
+}
+
+
+/**
+ * Removes a file from the system. Safe to call from any number of threads at once.
+ *
+ * @param system The ShardedSystem the file is deleted from.
+ * @param fileName Name of the file to be deleted.
+ * @return SYSTEM_OK if the file was deleted, SYSTEM_NOT_FOUND if no file has that name.
+ */
+int deleteFileFromShards(ShardedSystem* system, char* fileName) {
+    NameStripe* stripe = stripeOf(system, fileName);
+    pthread_mutex_lock(&stripe->lock);
+    long handle = findEntryInDirectory(&stripe->names, fileName);
+    if (handle < 0) {
+        pthread_mutex_unlock(&stripe->lock);
+        return SYSTEM_NOT_FOUND;
+    }
+
+    Shard* shard = shardOf(system, stripe->names.list[handle].start);
+    pthread_mutex_lock(&shard->lock);
+    deleteFileFromSystem(&shard->system, fileName);
+    pthread_mutex_unlock(&shard->lock);
+
+    deleteFromDirectory(&stripe->names, handle);
+    pthread_mutex_unlock(&stripe->lock);
+    return SYSTEM_OK;
+}
+
+
+/**
+ * Prints the number of files and the utilization and fragmentation metrics of the whole device
+ * to console, adding up the metrics of every shard. The largest free extent is the largest of
+ * any shard, since a file cannot span two shards. No other thread may be using the system.
+ *
+ * @param system The ShardedSystem to be summarized.
+ */
+void printShardedSummary(ShardedSystem* system) {
+    TableMetrics total = {0, 0, 0, 0, 0, 0};
+    long files = 0, stolen = 0, blocks = 0;
+    int i;
+    for (i = 0; i < NAME_STRIPES; i++) {
+        files += system->stripes[i].names.size;
+    }
+    for (i = 0; i < system->shardCount; i++) {
+        BlockTable* table = &system->shards[i].system.table;
+        TableMetrics m = getTableMetrics(table);
+        total.usedBytes += m.usedBytes;
+        total.fragmentedBytes += m.fragmentedBytes;
+        total.blocksInUse += m.blocksInUse;
+        total.freeBlocks += m.freeBlocks;
+        total.freeExtents += m.freeExtents;
+        if (m.largestFreeExtent > total.largestFreeExtent) {
+            total.largestFreeExtent = m.largestFreeExtent;
+        }
+        blocks += table->length;
+        stolen += system->shards[i].stolenAdds;
+    }
+    printf("Files stored:\t\t%ld\n", files);
+    printf("Shards:\t\t\t%d of %ld blocks\n", system->shardCount, system->shardBlocks);
+    printf("Adds placed off home shard:\t%ld\n", stolen);
+    printMetrics(&total, system->blockSize, blocks);
+}
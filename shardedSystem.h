@@ -0,0 +1,61 @@
+//
+// shardedSystem.h
+//
+
+#ifndef SHARDED_SYSTEM_H
+#define SHARDED_SYSTEM_H
+
+#include <pthread.h>
+#include "memorySystem.h"
+
+typedef struct shard Shard;
+typedef struct nameStripe NameStripe;
+typedef struct shardedSystem ShardedSystem;
+
+/* Number of locks the file names of a ShardedSystem are spread over. Must be a power of two. */
+#define NAME_STRIPES 64
+
+/**
+ * Definition of the Shard type. One region of the device, firstBlock onwards, managed as a
+ * MemorySystem of its own with its own BlockTable, free index and placement state, so threads
+ * working in different shards never touch the same allocator data. stolenAdds counts files
+ * that were placed here because the shard the adding thread started from had no room.
+ */
+struct shard {
+    pthread_mutex_t lock;
+    MemorySystem system;
+    long firstBlock;
+    long stolenAdds;
+};
+
+/**
+ * Definition of the NameStripe type. The files whose names hash to one stripe, with their
+ * blocks recorded as device-wide block numbers so the shard holding each file can be found.
+ */
+struct nameStripe {
+    pthread_mutex_t lock;
+    Directory names;
+};
+
+/**
+ * Definition of the ShardedSystem type. A thread-safe storage device split into shardCount
+ * equal Shards of shardBlocks blocks, the last one also taking any remainder. A file name is
+ * first claimed in its NameStripe, which keeps names unique across the whole device, then the
+ * file is placed in the calling thread's home shard or, failing that, in the next shard with
+ * room. Locks are always taken stripe first, then shard, and at most one of each is held.
+ */
+struct shardedSystem {
+    int shardCount;
+    long shardBlocks;
+    long blockSize;
+    Shard* shards;
+    NameStripe stripes[NAME_STRIPES];
+};
+
+ShardedSystem createShardedSystem(long systemSize, long blockSize, int shardCount, int policy, int backend);
+void destroyShardedSystem(ShardedSystem* system);
+int addFileToShards(ShardedSystem* system, int homeShard, char* fileName, long fileSize);
+int deleteFileFromShards(ShardedSystem* system, char* fileName);
+void printShardedSummary(ShardedSystem* system);
+
+#endif
@@ -0,0 +1,266 @@
+//
+// snapshot.c
+//
+// Saves a MemorySystem to a snapshot file and restores it again, see snapshot.h for the layout.
+// A snapshot only holds what cannot be derived: the files with their names and blocks, and the
+// state of the placement policy. The BlockTable columns, free index and running totals follow
+// from the files, so they are rebuilt on restore with one range update per file, which keeps
+// snapshots small and lets a snapshot taken with one BlockTable backend be restored into either.
+//
+
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Size of the stdio buffer snapshots are written through. */
+#define SNAPSHOT_WRITE_BUFFER (1 << 20)
+
+
+/**
+ * Finds the free extent after the given one in a start ordered ExtentTree.
+ */
+static ExtentNode* nextExtent(ExtentTree* tree, ExtentNode* node) {
+    return findCeilingExtent(tree, node->start + node->length);
+}
+
+
+/**
+ * Saves the files and placement state of a MemorySystem to a snapshot file.
+ *
+ * @param system The MemorySystem to be saved.
+ * @param path Path of the snapshot file, which is replaced if it exists.
+ * @return 0 if the snapshot was written, -1 otherwise.
+ */
+int saveSnapshot(MemorySystem* system, const char* path) {
+    Directory* d = &system->directory;
+    Placement* p = &system->placement;
+    SnapshotHeader header;
+    ExtentNode* node;
+    long handle;
+    int order;
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Could not open snapshot file: %s\n", path);
+        return -1;
+    }
+    setvbuf(file, NULL, _IOFBF, SNAPSHOT_WRITE_BUFFER);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.policy = p->policy;
+    header.blockSize = system->table.blockSize;
+    header.length = system->table.length;
+    header.files = d->size;
+    header.rover = p->rover;
+    for (order = 0; p->buddyFree != NULL && order <= p->maxOrder; order++) {
+        header.buddyExtents += p->buddyFree[order].count;
+    }
+    for (handle = firstEntry(d); handle >= 0; handle = nextEntry(d, handle)) {
+        header.namesLength += strlen(d->list[handle].fileName) + 1;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+
+    int64_t nameOffset = 0;
+    for (handle = firstEntry(d); handle >= 0; handle = nextEntry(d, handle)) {
+        Entry* e = &d->list[handle];
+        SnapshotFile record = {e->size, e->start, e->length, nameOffset};
+        fwrite(&record, sizeof(record), 1, file);
+        nameOffset += strlen(e->fileName) + 1;
+    }
+    for (order = 0; p->buddyFree != NULL && order <= p->maxOrder; order++) {
+        for (node = findFirstExtent(&p->buddyFree[order]); node != NULL; node = nextExtent(&p->buddyFree[order], node)) {
+            int64_t extent[2] = {node->start, node->length};
+            fwrite(extent, sizeof(extent), 1, file);
+        }
+    }
+    for (handle = firstEntry(d); handle >= 0; handle = nextEntry(d, handle)) {
+        fputs(d->list[handle].fileName, file);
+        fputc('\0', file);
+    }
+
+    if (ferror(file) | fclose(file)) {
+        printf("Could not write snapshot file: %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * Checks that the header of a mapped snapshot is one this build can read, and that the file is
+ * long enough to hold every section the header describes.
+ */
+static int checkHeader(const SnapshotHeader* header, long fileLength) {
+    if (fileLength < (long) sizeof(SnapshotHeader) || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) {
+        printf("Not a snapshot file.\n");
+        return -1;
+    } else if (header->version != SNAPSHOT_VERSION) {
+        printf("Snapshot version %u is not supported, expected %d.\n", header->version, SNAPSHOT_VERSION);
+        return -1;
+    } else if (header->policy < 0 || header->policy >= POLICY_COUNT || header->files < 0
+               || header->buddyExtents < 0 || header->namesLength < 0 || header->length <= 0
+               || header->blockSize <= 0 || header->blockSize > LONG_MAX / header->length
+               || checkSystemSize(header->blockSize * header->length, header->blockSize) != 0) {
+        printf("Snapshot header is corrupt.\n");
+        return -1;
+    } else if (header->files > fileLength || header->buddyExtents > fileLength || header->namesLength > fileLength) {
+        printf("Snapshot file is truncated.\n");
+        return -1;
+    }
+    long needed = sizeof(SnapshotHeader) + header->files * sizeof(SnapshotFile)
+                  + header->buddyExtents * 2 * sizeof(int64_t) + header->namesLength;
+    if (needed > fileLength) {
+        printf("Snapshot file is truncated.\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * Adds one file record of a snapshot to the Directory of a freshly restored MemorySystem, after
+ * checking that its name and blocks are sound. Its blocks are claimed later by claimBlocks().
+ */
+static int restoreFile(MemorySystem* system, const SnapshotFile* record, const char* names, long namesLength) {
+    BlockTable* table = &system->table;
+    if (record->start < 0 || record->length <= 0 || record->start > table->length - record->length
+        || record->size <= 0 || record->size > record->length * table->blockSize
+        || blocksForSize(table, record->size) != record->length
+        || record->nameOffset < 0 || record->nameOffset >= namesLength
+        || memchr(names + record->nameOffset, '\0', namesLength - record->nameOffset) == NULL) {
+        return -1;
+    }
+    char* fileName = (char*) names + record->nameOffset;
+    return addToDirectory(&system->directory, createEntry(fileName, record->size, record->start, record->length)) < 0 ? -1 : 0;
+}
+
+
+/**
+ * Marks the blocks of every restored file as used in the BlockTable. The files are visited in
+ * block order through the Directory's extents rather than in the order they were saved, so each
+ * update carves the front off of the same free extent, and overlapping files are easy to spot.
+ */
+static int claimBlocks(MemorySystem* system) {
+    Directory* d = &system->directory;
+    ExtentNode* node;
+    long end = 0, claimed = 0;
+    for (node = findFirstExtent(&d->extents); node != NULL; node = findCeilingExtent(&d->extents, node->start + 1)) {
+        if (node->start < end) {
+            return -1;
+        }
+        updateTable(&system->table, node->start, d->list[node->owner].size);
+        end = node->start + node->length;
+        claimed++;
+    }
+    return claimed == d->size ? 0 : -1;  // Files sharing a start block are stepped over above.
+}
+
+
+/**
+ * Replaces the free lists of a restored buddy Placement with the ones saved in the snapshot.
+ */
+static int restoreBuddy(Placement* placement, const int64_t* extents, long count, long length) {
+    long i;
+    int order;
+    for (order = 0; order <= placement->maxOrder; order++) {
+        clearExtentTree(&placement->buddyFree[order]);
+    }
+    for (i = 0; i < count; i++) {
+        long start = extents[2 * i], blocks = extents[2 * i + 1];
+        if (blocks <= 0 || (blocks & (blocks - 1)) != 0 || start < 0 || start > length - blocks
+            || (start & (blocks - 1)) != 0) {
+            return -1;
+        }
+        order = __builtin_ctzl(blocks);
+        if (order > placement->maxOrder) {
+            return -1;
+        }
+        insertExtent(&placement->buddyFree[order], start, blocks);
+    }
+    return 0;
+}
+
+
+/**
+ * Restores a MemorySystem from a snapshot file. The file is mapped rather than read, and its
+ * records and names are used where they lie in the mapping, so restoring costs one directory
+ * insert and one BlockTable range update per file. The restored system has compaction off.
+ *
+ * @param system Receives the restored MemorySystem, only when the restore succeeds.
+ * @param path Path of the snapshot file.
+ * @param policy The POLICY_ constant of the placement policy to restore with, or -1 for the one
+ *               saved in the snapshot. A snapshot can only be restored with buddy placement if it
+ *               was saved with it, since other policies do not keep files on buddy boundaries.
+ * @param backend The TABLE_ constant of the BlockTable backend to restore into.
+ * @return 0 if the snapshot was restored, -1 otherwise.
+ */
+int loadSnapshot(MemorySystem* system, const char* path, int policy, int backend) {
+    struct stat status;
+    int result = 0;
+    long i;
+
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+        printf("Could not open snapshot file: %s\n", path);
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+        return -1;
+    }
+    long fileLength = status.st_size;
+    void* mapping = fileLength > 0 ? mmap(NULL, fileLength, PROT_READ, MAP_PRIVATE, descriptor, 0) : MAP_FAILED;
+    close(descriptor);
+    if (mapping == MAP_FAILED) {
+        printf("Could not map snapshot file: %s\n", path);
+        return -1;
+    }
+    madvise(mapping, fileLength, MADV_SEQUENTIAL);
+
+    const SnapshotHeader* header = mapping;
+    if (checkHeader(header, fileLength) != 0) {
+        munmap(mapping, fileLength);
+        return -1;
+    }
+    if (policy < 0) {
+        policy = header->policy;
+    } else if (policy == POLICY_BUDDY && header->policy != POLICY_BUDDY) {
+        printf("Only snapshots saved with buddy placement can be restored with it.\n");
+        munmap(mapping, fileLength);
+        return -1;
+    }
+
+    const SnapshotFile* records = (const SnapshotFile*) (header + 1);
+    const int64_t* buddyExtents = (const int64_t*) (records + header->files);
+    const char* names = (const char*) (buddyExtents + 2 * header->buddyExtents);
+
+    MemorySystem restored = createMemorySystem(header->blockSize * header->length, header->blockSize, policy, backend);
+    for (i = 0; i < header->files && result == 0; i++) {
+        result = restoreFile(&restored, &records[i], names, header->namesLength);
+    }
+    if (result == 0) {
+        result = claimBlocks(&restored);
+    }
+    if (result == 0 && policy == POLICY_BUDDY) {
+        result = restoreBuddy(&restored.placement, buddyExtents, header->buddyExtents, header->length);
+    }
+    if (result == 0 && policy == header->policy && header->rover >= 0 && header->rover < header->length) {
+        restored.placement.rover = header->rover;
+    }
+    munmap(mapping, fileLength);
+
+    if (result != 0) {
+        printf("Snapshot file is corrupt: %s\n", path);
+        destroyMemorySystem(&restored);
+        return -1;
+    }
+    *system = restored;
+    return 0;
+}
@@ -0,0 +1,52 @@
+//
+// snapshot.h
+//
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "memorySystem.h"
+
+typedef struct snapshotHeader SnapshotHeader;
+typedef struct snapshotFile SnapshotFile;
+
+/* Identifies a snapshot file, and the version of the layout below that it was written with. */
+#define SNAPSHOT_MAGIC "BTSNAP1"
+#define SNAPSHOT_VERSION 1
+
+/**
+ * Definition of the SnapshotHeader type, the start of every snapshot file. It is followed by
+ * files SnapshotFile records in directory order, then buddyExtents pairs of 64-bit start and
+ * length (the free lists of the buddy policy, empty for other policies), then namesLength bytes
+ * holding every file name, each ending in a NUL. Every field is stored in the byte order of the
+ * machine that wrote the file, and every section starts 8-byte aligned, so a mapped snapshot
+ * can be read in place.
+ */
+struct snapshotHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t policy;
+    int64_t blockSize;
+    int64_t length;
+    int64_t files;
+    int64_t buddyExtents;
+    int64_t namesLength;
+    int64_t rover;
+};
+
+/**
+ * Definition of the SnapshotFile type. One stored file: its size and blocks, and where its
+ * name starts in the names section.
+ */
+struct snapshotFile {
+    int64_t size;
+    int64_t start;
+    int64_t length;
+    int64_t nameOffset;
+};
+
+int saveSnapshot(MemorySystem* system, const char* path);
+int loadSnapshot(MemorySystem* system, const char* path, int policy, int backend);
+
+#endif
@@ -0,0 +1,306 @@
+//
+// sweep.c
+//
+// Replays one trace against many configurations at once. A sweep is given as a list of
+// key=value settings separated by commas, where every value is a list separated by slashes:
+//
+//     size     System sizes in bytes, K, M and G suffixes allowed (default: the trace's).
+//     block    Block sizes in bytes, K, M and G suffixes allowed (default: the trace's).
+//     policy   Placement policies (default: the one chosen with -p).
+//
+// The suffixes are binary, 4K is 4096 bytes and 10M is 10485760, since device and block sizes
+// are powers of two.
+//
+// For example size=10M,block=512/1K/4K,policy=first/best replays the trace six times. The trace
+// is shared read-only between the worker threads, each of which takes the next configuration
+// not yet started, replays the whole trace against a new system, and keeps its metrics. Only the
+// adds and deletes of the trace are replayed, every configuration keeps its own size throughout.
+//
+
+#include "sweep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/**
+ * Work shared by the threads of a sweep: the trace, the settings, and the configurations, of
+ * which next is the first no thread has started yet.
+ */
+typedef struct sweepQueue {
+    pthread_mutex_t lock;
+    Sweep* sweep;
+    Trace* trace;
+    SweepResult* results;
+    long count;
+    long next;
+} SweepQueue;
+
+
+/**
+ * Parses a size in bytes, which may end in K, M or G to multiply it by 2^10, 2^20 or 2^30.
+ *
+ * @param text The size, for example 4K.
+ * @return The size, or -1 if the text is not a positive size.
+ */
+long parseSize(const char* text) {
+    char* endPointer;
+    long scale = 1;
+    errno = 0;
+    long value = strtol(text, &endPointer, 10);
+    if (*endPointer == 'K' || *endPointer == 'k') {
+        scale = 1L << 10;
+        endPointer++;
+    } else if (*endPointer == 'M' || *endPointer == 'm') {
+        scale = 1L << 20;
+        endPointer++;
+    } else if (*endPointer == 'G' || *endPointer == 'g') {
+        scale = 1L << 30;
+        endPointer++;
+    }
+    // Checked before scaling so that large values are rejected instead of wrapping around.
+    if (*endPointer != '\0' || errno == ERANGE || value <= 0 || value > LONG_MAX / scale) {
+        return -1;
+    }
+    return value * scale;
+}
+
+
+/**
+ * Parses a slash separated list of sizes, or of placement policy names, into values.
+ *
+ * @return 0 if the whole list was valid, -1 otherwise.
+ */
+static int parseSweepList(char* text, long* values, int* count, int isPolicy) {
+    *count = 0;
+    while (text != NULL) {
+        char* separator = strchr(text, '/');
+        if (separator != NULL) {
+            *separator = '\0';
+        }
+        long value = isPolicy ? parsePolicy(text) : parseSize(text);
+        if (value < 0 || *count == SWEEP_MAX_LIST) {
+            return -1;
+        }
+        values[(*count)++] = value;
+        text = separator != NULL ? separator + 1 : NULL;
+    }
+    return 0;
+}
+
+
+/**
+ * Creates a Sweep with every list empty, so that a trace is replayed once with its own sizes and
+ * first fit placement, and with one worker per online processor.
+ *
+ * @return A Sweep with default settings.
+ */
+Sweep createSweep(void) {
+    Sweep sweep;
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    sweep.systemSizeCount = 0;
+    sweep.blockSizeCount = 0;
+    sweep.policyCount = 0;
+    sweep.backend = TABLE_BLOCKS;
+    sweep.compactMode = COMPACT_OFF;
+    sweep.compactStep = 0;
+    sweep.workers = processors > 0 ? (int) processors : 1;
+    return sweep;
+}
+
+
+/**
+ * Parses a sweep spec, see the top of this file, into a Sweep. Settings not given in the spec
+ * keep their current values.
+ *
+ * @param sweep Receives the parsed settings.
+ * @param spec The settings, for example size=10M,block=512/4K,policy=first/best.
+ * @return 0 if every setting was valid, -1 otherwise.
+ */
+int parseSweep(Sweep* sweep, const char* spec) {
+    char* copy = malloc(strlen(spec) + 1);
+    char* setting;
+    int result = 0;
+    strcpy(copy, spec);
+
+    for (setting = strtok(copy, ","); setting != NULL && result == 0; setting = strtok(NULL, ",")) {
+        char* value = strchr(setting, '=');
+        long policies[SWEEP_MAX_LIST];
+        int i;
+        if (value == NULL) {
+            printf("Sweep setting is not of the form key=value: %s\n", setting);
+            result = -1;
+            continue;
+        }
+        *value = '\0';
+        value++;
+        if (strcmp(setting, "size") == 0) {
+            result = parseSweepList(value, sweep->systemSizes, &sweep->systemSizeCount, 0);
+        } else if (strcmp(setting, "block") == 0) {
+            result = parseSweepList(value, sweep->blockSizes, &sweep->blockSizeCount, 0);
+        } else if (strcmp(setting, "policy") == 0) {
+            result = parseSweepList(value, policies, &sweep->policyCount, 1);
+            for (i = 0; i < sweep->policyCount; i++) {
+                sweep->policies[i] = (int) policies[i];
+            }
+        } else {
+            result = -1;
+        }
+        if (result != 0) {
+            printf("Invalid sweep setting: %s=%s\n", setting, value);
+        }
+    }
+    free(copy);
+    return result;
+}
+
+
+/**
+ * Replays a whole trace against the configuration of one SweepResult and fills in the rest of it.
+ * Print and summary operations in the trace are skipped.
+ */
+static void replayConfiguration(SweepQueue* queue, SweepResult* result) {
+    struct timespec begin, end;
+    Sweep* sweep = queue->sweep;
+    Trace* trace = queue->trace;
+    long i;
+
+    MemorySystem system = createMemorySystem(result->systemSize, result->blockSize, result->policy, sweep->backend);
+    if (setCompaction(&system, sweep->compactMode, sweep->compactStep) != 0) {
+        destroyMemorySystem(&system);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (i = 0; i < trace->count; i++) {
+        Operation* op = trace->ops + i;
+        if (op->type == OP_ADD) {
+            result->adds++;
+            if (addFileToSystem(&system, operationName(trace, op), op->size) == SYSTEM_NO_SPACE) {
+                result->addsFailed++;
+            }
+        } else if (op->type == OP_DELETE) {
+            deleteFileFromSystem(&system, operationName(trace, op));
+        }
+        stepCompaction(&system);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    result->seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+    result->metrics = getTableMetrics(&system.table);
+    result->status = 0;
+    destroyMemorySystem(&system);
+}
+
+
+/**
+ * Thread body of a sweep: replays configurations until none are left to start.
+ */
+static void* sweepWorker(void* argument) {
+    SweepQueue* queue = argument;
+    while (1) {
+        pthread_mutex_lock(&queue->lock);
+        long index = queue->next < queue->count ? queue->next++ : -1;
+        pthread_mutex_unlock(&queue->lock);
+        if (index < 0) {
+            return NULL;
+        }
+        replayConfiguration(queue, &queue->results[index]);
+    }
+}
+
+
+/**
+ * Prints one row of the sweep table.
+ */
+static void printSweepResult(SweepResult* r, long operations) {
+    TableMetrics* m = &r->metrics;
+    long allocatedBytes = m->blocksInUse * r->blockSize;
+    printf("%-14ld%-12ld%-8s", r->systemSize, r->blockSize, policyName(r->policy));
+    if (r->status != 0) {
+        printf("compaction cannot be used with this policy\n");
+        return;
+    }
+    printf("%9.2f%%%9.2f%%%9.2f%%%12.0f\n",
+           allocatedBytes > 0 ? 100.0 * m->fragmentedBytes / allocatedBytes : 0,
+           m->freeBlocks > 0 ? 100.0 * (m->freeBlocks - m->largestFreeExtent) / m->freeBlocks : 0,
+           r->adds > 0 ? 100.0 * r->addsFailed / r->adds : 0,
+           r->seconds > 0 ? operations / r->seconds : 0);
+}
+
+
+/**
+ * Replays a trace against every configuration of a Sweep, sharing the configurations between
+ * sweep->workers threads, then prints one row per configuration in the order they were listed:
+ * internal fragmentation as a share of allocated bytes, external fragmentation as the share of
+ * free blocks outside the largest free extent, the share of adds that found no space, and the
+ * replay throughput. Configurations whose sizes do not fit together are reported and left out.
+ *
+ * @param sweep The configurations to be replayed.
+ * @param trace The operations to be replayed, which are only read.
+ * @return 0 if the sweep ran, -1 if no configuration was valid.
+ */
+int runSweep(Sweep* sweep, Trace* trace) {
+    long systemSizes[1] = {trace->systemSize};
+    long blockSizes[1] = {trace->blockSize};
+    int policies[1] = {POLICY_FIRST_FIT};
+    long* sizeList = sweep->systemSizeCount > 0 ? sweep->systemSizes : systemSizes;
+    long* blockList = sweep->blockSizeCount > 0 ? sweep->blockSizes : blockSizes;
+    int* policyList = sweep->policyCount > 0 ? sweep->policies : policies;
+    int sizeCount = sweep->systemSizeCount > 0 ? sweep->systemSizeCount : 1;
+    int blockCount = sweep->blockSizeCount > 0 ? sweep->blockSizeCount : 1;
+    int policyCount = sweep->policyCount > 0 ? sweep->policyCount : 1;
+    SweepQueue queue;
+    int i, j, k;
+
+    queue.sweep = sweep;
+    queue.trace = trace;
+    queue.results = calloc((long) sizeCount * blockCount * policyCount, sizeof(SweepResult));
+    queue.count = 0;
+    queue.next = 0;
+    for (i = 0; i < sizeCount; i++) {
+        for (j = 0; j < blockCount; j++) {
+            if (checkSystemSize(sizeList[i], blockList[j]) != 0) {
+                printf("Skipping system size %ld with block size %ld.\n", sizeList[i], blockList[j]);
+                continue;
+            }
+            for (k = 0; k < policyCount; k++) {
+                SweepResult* r = &queue.results[queue.count++];
+                r->systemSize = sizeList[i];
+                r->blockSize = blockList[j];
+                r->policy = policyList[k];
+                r->status = -1;
+            }
+        }
+    }
+    if (queue.count == 0) {
+        free(queue.results);
+        return -1;
+    }
+
+    int workers = sweep->workers < queue.count ? sweep->workers : (int) queue.count;
+    pthread_t* threads = malloc(sizeof(pthread_t) * workers);
+    pthread_mutex_init(&queue.lock, NULL);
+    for (i = 0; i < workers; i++) {
+        pthread_create(&threads[i], NULL, sweepWorker, &queue);
+    }
+    for (i = 0; i < workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+
+    printf("Replayed %ld operations against %ld configurations on %d worker threads, block table: %s\n",
+           trace->count, queue.count, workers, backendName(sweep->backend));
+    printf("%-14s%-12s%-8s%10s%10s%10s%12s\n", "System size", "Block size", "Policy",
+           "Internal", "External", "Failed", "Ops/sec");
+    for (i = 0; i < queue.count; i++) {
+        printSweepResult(&queue.results[i], trace->count);
+    }
+    free(threads);
+    free(queue.results);
+    return 0;
+}
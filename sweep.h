@@ -0,0 +1,57 @@
+//
+// sweep.h
+//
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "memorySystem.h"
+#include "trace.h"
+
+typedef struct sweep Sweep;
+typedef struct sweepResult SweepResult;
+
+/* Most values one list of a Sweep may hold. */
+#define SWEEP_MAX_LIST 32
+
+/**
+ * Definition of the Sweep type. The system sizes, block sizes and placement policies a trace is
+ * replayed against; every combination of the three is one configuration. An empty list stands
+ * for the value the trace itself gives. backend, compactMode and compactStep apply to every
+ * configuration, and workers is the number of threads the configurations are shared between.
+ */
+struct sweep {
+    long systemSizes[SWEEP_MAX_LIST];
+    int systemSizeCount;
+    long blockSizes[SWEEP_MAX_LIST];
+    int blockSizeCount;
+    int policies[SWEEP_MAX_LIST];
+    int policyCount;
+    int backend;
+    int compactMode;
+    long compactStep;
+    int workers;
+};
+
+/**
+ * Definition of the SweepResult type. The outcome of replaying the trace against one
+ * configuration of a Sweep. status is 0 once the replay has run, -1 if the configuration
+ * could not be created.
+ */
+struct sweepResult {
+    long systemSize;
+    long blockSize;
+    int policy;
+    int status;
+    long adds;
+    long addsFailed;
+    double seconds;
+    TableMetrics metrics;
+};
+
+long parseSize(const char* text);
+Sweep createSweep(void);
+int parseSweep(Sweep* sweep, const char* spec);
+int runSweep(Sweep* sweep, Trace* trace);
+
+#endif
@@ -0,0 +1,285 @@
+//
+// tieredSystem.c
+//
+// Splits one storage device into size classes, each with its own block size. A size class spec
+// is a slash separated list of block sizes, binary K, M and G suffixes allowed as in a sweep, each
+// of which may be followed by a colon and the number of parts of the device the class gets:
+//
+//     512/4K/64K        Three classes, a third of the device each.
+//     512:1/4K:2/64K:5  The same classes with an eighth, a quarter and five eighths of the device.
+//
+// Every file goes to the class with the largest blocks that waste at most 1 / TIER_WASTE_DIVISOR
+// of its size in its last block, or to the class with the smallest blocks if none does. If that
+// class has no room the classes with smaller blocks are tried, largest first, then those with
+// larger blocks, so an add only fails when no class can hold the file.
+//
+
+#include "tieredSystem.h"
+#include "sweep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+/**
+ * Parses a size class spec, see the top of this file, into the tiers of a TieredSystem, ordered
+ * by block size. Nothing is allocated until createTieredSystem().
+ *
+ * @param system Receives the block size and share of every class.
+ * @param spec The size classes, for example 512/4K/64K.
+ * @return 0 if every class was valid, -1 otherwise.
+ */
+int parseTiers(TieredSystem* system, const char* spec) {
+    char* copy = malloc(strlen(spec) + 1);
+    char* item;
+    int result = 0;
+    strcpy(copy, spec);
+
+    system->tierCount = 0;
+    for (item = strtok(copy, "/"); item != NULL && result == 0; item = strtok(NULL, "/")) {
+        char* shareText = strchr(item, ':');
+        char* endPointer = NULL;
+        long share = 1;
+        int i;
+        if (shareText != NULL) {
+            *shareText = '\0';
+        }
+        long blockSize = parseSize(item);
+        if (shareText != NULL) {
+            errno = 0;
+            share = strtol(shareText + 1, &endPointer, 10);
+        }
+        for (i = 0; i < system->tierCount && system->tiers[i].blockSize != blockSize; i++);
+        if (blockSize < 0 || (endPointer != NULL && (*endPointer != '\0' || errno == ERANGE)) || share <= 0
+            || i < system->tierCount || system->tierCount == MAX_TIERS) {
+            printf("Invalid size class: %s%s%s\n", item, shareText != NULL ? ":" : "", shareText != NULL ? shareText + 1 : "");
+            result = -1;
+            continue;
+        }
+
+        // Insert in block size order, moving the classes with larger blocks up one.
+        for (i = system->tierCount; i > 0 && system->tiers[i - 1].blockSize > blockSize; i--) {
+            system->tiers[i] = system->tiers[i - 1];
+        }
+        system->tiers[i].blockSize = blockSize;
+        system->tiers[i].share = share;
+        system->tierCount++;
+    }
+    free(copy);
+    if (result == 0 && system->tierCount == 0) {
+        printf("No size classes given.\n");
+        result = -1;
+    }
+    return result;
+}
+
+
+/**
+ * Creates the MemorySystem of every size class parsed by parseTiers(). The device is divided
+ * between the classes by their shares, from the class with the largest blocks down. Every region
+ * is cut down to a whole number of its blocks, and what is cut off goes on to the next class, so
+ * the class with the smallest blocks takes whatever is left. Only a remainder smaller than its
+ * blocks is left unused, which is recorded in unusedBytes.
+ *
+ * @param system The TieredSystem whose classes have been parsed.
+ * @param systemSize Total size of the storage device.
+ * @param policy The POLICY_ constant of the placement policy used within every class.
+ * @param backend The TABLE_ constant of the BlockTable backend of every class.
+ * @return 0 if every class was created, -1 if a region cannot hold a table of its block size,
+ *         in which case nothing is left to destroy.
+ */
+int createTieredSystem(TieredSystem* system, long systemSize, int policy, int backend) {
+    long totalShare = 0, given = 0, owed = 0;
+    int i;
+    for (i = 0; i < system->tierCount; i++) {
+        totalShare += system->tiers[i].share;
+    }
+    for (i = system->tierCount - 1; i >= 0; i--) {
+        Tier* tier = &system->tiers[i];
+        long region = i > 0 ? systemSize / totalShare * tier->share + owed : systemSize - given;
+        owed = region % tier->blockSize;
+        region -= owed;
+        if (region == 0 || checkSystemSize(region, tier->blockSize) != 0) {
+            printf("The size class of %ld byte blocks cannot be given %ld of %ld bytes.\n", tier->blockSize,
+                   region, systemSize);
+            for (i++; i < system->tierCount; i++) {
+                destroyMemorySystem(&system->tiers[i].system);
+            }
+            system->tierCount = 0;
+            return -1;
+        }
+        given += region;
+        tier->system = createMemorySystem(region, tier->blockSize, policy, backend);
+        tier->spilledAdds = 0;
+        system->singleWaste[i] = 0;
+    }
+    system->unusedBytes = systemSize - given;
+    system->storedBytes = 0;
+    return 0;
+}
+
+
+/**
+ * Frees all dynamically allocated memory held by a TieredSystem.
+ *
+ * @param system The TieredSystem to be destroyed.
+ */
+void destroyTieredSystem(TieredSystem* system) {
+    int i;
+    for (i = 0; i < system->tierCount; i++) {
+        destroyMemorySystem(&system->tiers[i].system);
+    }
+    system->tierCount = 0;
+}
+
+
+/**
+ * Gives the bytes a file leaves unused in its last block.
+ */
+static long wasteFor(long fileSize, long blockSize) {
+    return (fileSize + blockSize - 1) / blockSize * blockSize - fileSize;
+}
+
+
+/**
+ * Finds the size class a file is routed to: the one with the largest blocks that leave at most
+ * 1 / TIER_WASTE_DIVISOR of the file unused, or the one with the smallest blocks if none do.
+ *
+ * @param system The TieredSystem the file is to be added to.
+ * @param fileSize Size of the file, must be greater than zero.
+ * @return Index of the size class in system->tiers.
+ */
+int chooseTier(TieredSystem* system, long fileSize) {
+    int i;
+    for (i = system->tierCount - 1; i > 0; i--) {
+        if (wasteFor(fileSize, system->tiers[i].blockSize) <= fileSize / TIER_WASTE_DIVISOR) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Adds a stored file to, or with sign -1 takes it out of, the running totals of a TieredSystem.
+ */
+static void countFile(TieredSystem* system, long fileSize, int sign) {
+    int i;
+    system->storedBytes += sign * fileSize;
+    for (i = 0; i < system->tierCount; i++) {
+        system->singleWaste[i] += sign * wasteFor(fileSize, system->tiers[i].blockSize);
+    }
+}
+
+
+/**
+ * Stores a new file in the size class chooseTier() routes it to, or if that class has no room,
+ * in the nearest class that does, trying smaller blocks before larger ones.
+ *
+ * @param system The TieredSystem the file is added to.
+ * @param fileName Name of the new file.
+ * @param fileSize Size of the new file, must be greater than zero.
+ * @return SYSTEM_OK if the file was added, SYSTEM_NO_SPACE if no class has enough contiguous
+ *         memory, SYSTEM_DUPLICATE if a file with the same name is already stored in any class,
+ *         SYSTEM_BAD_NAME if the name is MAX_FILE_NAME bytes or longer.
+ */
+int addFileToTiers(TieredSystem* system, char* fileName, long fileSize) {
+    int home = chooseTier(system, fileSize);
+    int i, k;
+    if (strlen(fileName) >= MAX_FILE_NAME) {
+        return SYSTEM_BAD_NAME;
+    }
+    for (i = 0; i < system->tierCount; i++) {
+        if (findEntryInDirectory(&system->tiers[i].system.directory, fileName) >= 0) {
+            return SYSTEM_DUPLICATE;
+        }
+    }
+
+    // k counts the classes tried: home, then home - 1 down to 0, then home + 1 upwards.
+    for (k = 0; k < system->tierCount; k++) {
+        Tier* tier = &system->tiers[k <= home ? home - k : k];
+        BlockTable* table = &tier->system.table;
+        if (table->freeIndex.freeBlocks >= blocksForSize(table, fileSize)
+            && addFileToSystem(&tier->system, fileName, fileSize) == SYSTEM_OK) {
+            if (k > 0) {
+                tier->spilledAdds++;
+            }
+            countFile(system, fileSize, 1);
+            return SYSTEM_OK;
+        }
+    }
+    return SYSTEM_NO_SPACE;
+}
+
+
+/**
+ * Removes a file from whichever size class holds it.
+ *
+ * @param system The TieredSystem the file is deleted from.
+ * @param fileName Name of the file to be deleted.
+ * @return SYSTEM_OK if the file was deleted, SYSTEM_NOT_FOUND if no file has that name.
+ */
+int deleteFileFromTiers(TieredSystem* system, char* fileName) {
+    int i;
+    for (i = 0; i < system->tierCount; i++) {
+        MemorySystem* local = &system->tiers[i].system;
+        long handle = findEntryInDirectory(&local->directory, fileName);
+        if (handle >= 0) {
+            countFile(system, local->directory.list[handle].size, -1);
+            deleteFileFromSystem(local, fileName);
+            return SYSTEM_OK;
+        }
+    }
+    return SYSTEM_NOT_FOUND;
+}
+
+
+/**
+ * Prints one row per size class to console: its region, the files it holds, their internal
+ * fragmentation and the memory of its BlockTable. Then prints, for the block size of every class,
+ * the fragmentation the stored files would have, and the memory the table would need, if the
+ * whole device used that block size, and how much the classes save over it. The table memory of
+ * a single-size layout is estimated as the per-block columns of the whole device plus as many
+ * extent nodes as all the classes hold together.
+ *
+ * @param system The TieredSystem to be summarized.
+ */
+void printTieredSummary(TieredSystem* system) {
+    long files = 0, blocks = 0, fragmented = 0, memory = 0, nodes = 0, deviceBytes = 0;
+    int i;
+
+    printf("Bytes stored:\t\t%ld\n", system->storedBytes);
+    printf("%-12s%-14s%-10s%-14s%-16s%-14s%s\n", "Block size", "Region bytes", "Files", "Blocks used",
+           "Fragmented", "Table memory", "Spilled");
+    for (i = 0; i < system->tierCount; i++) {
+        Tier* tier = &system->tiers[i];
+        BlockTable* table = &tier->system.table;
+        long allocatedBytes = table->blocksInUse * table->blockSize;
+        char waste[48];
+        snprintf(waste, sizeof(waste), "%ld (%.1f%%)", table->fragmentedBytes,
+                 allocatedBytes > 0 ? 100.0 * table->fragmentedBytes / allocatedBytes : 0);
+        printf("%-12ld%-14ld%-10ld%-14ld%-16s%-14ld%ld\n", tier->blockSize, table->length * table->blockSize,
+               tier->system.directory.size, table->blocksInUse, waste, tableMemory(table), tier->spilledAdds);
+        files += tier->system.directory.size;
+        blocks += table->blocksInUse;
+        fragmented += table->fragmentedBytes;
+        memory += tableMemory(table);
+        nodes += table->allocated.count + table->freeIndex.byStart.count + table->freeIndex.byLength.count;
+        deviceBytes += table->length * table->blockSize;
+    }
+    printf("%-12s%-14ld%-10ld%-14ld%-16ld%ld\n", "All", deviceBytes, files, blocks, fragmented, memory);
+    if (system->unusedBytes > 0) {
+        printf("Unused:\t\t\t%ld bytes, less than one block of any class\n", system->unusedBytes);
+    }
+
+    printf("\n%-12s%-16s%-14s%-21s%s\n", "Single size", "Fragmented", "Table memory", "Fragmentation saved",
+           "Memory saved");
+    for (i = 0; i < system->tierCount; i++) {
+        long blockSize = system->tiers[i].blockSize;
+        long singleMemory = columnBytes(deviceBytes / blockSize, system->tiers[i].system.table.backend)
+                            + nodes * (long) sizeof(ExtentNode);
+        printf("%-12ld%-16ld%-14ld%-21ld%ld\n", blockSize, system->singleWaste[i], singleMemory,
+               system->singleWaste[i] - fragmented, singleMemory - memory);
+    }
+}
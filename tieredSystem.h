@@ -0,0 +1,58 @@
+//
+// tieredSystem.h
+//
+
+#ifndef TIERED_SYSTEM_H
+#define TIERED_SYSTEM_H
+
+#include "memorySystem.h"
+
+typedef struct tier Tier;
+typedef struct tieredSystem TieredSystem;
+
+/* Most size classes a TieredSystem may have. */
+#define MAX_TIERS 8
+
+/* A file goes to the size class with the largest blocks that leave at most 1 / TIER_WASTE_DIVISOR
+ * of its size unused in its last block. */
+#define TIER_WASTE_DIVISOR 8
+
+/**
+ * Definition of the Tier type. One size class: a region of the device, share parts of it, with
+ * a block size of its own, managed as a MemorySystem with its own BlockTable, free index and
+ * placement state. spilledAdds counts files that were placed here because the class they were
+ * routed to had no room.
+ */
+struct tier {
+    long blockSize;
+    long share;
+    MemorySystem system;
+    long spilledAdds;
+};
+
+/**
+ * Definition of the TieredSystem type. A storage device split into tierCount size classes,
+ * ordered by block size, so that small files do not have to waste most of a large block and
+ * large files do not need a long run of small ones. File names are unique across the device.
+ * unusedBytes is the end of the device too small to be a block of any class. storedBytes is the
+ * total size of the files stored, and singleWaste holds, for the block size of each class, the
+ * internal fragmentation the same files would have if the whole device used that one block
+ * size, so the classes can be compared with a single-size layout.
+ */
+struct tieredSystem {
+    int tierCount;
+    Tier tiers[MAX_TIERS];
+    long unusedBytes;
+    long storedBytes;
+    long singleWaste[MAX_TIERS];
+};
+
+int parseTiers(TieredSystem* system, const char* spec);
+int createTieredSystem(TieredSystem* system, long systemSize, int policy, int backend);
+void destroyTieredSystem(TieredSystem* system);
+int chooseTier(TieredSystem* system, long fileSize);
+int addFileToTiers(TieredSystem* system, char* fileName, long fileSize);
+int deleteFileFromTiers(TieredSystem* system, char* fileName);
+void printTieredSummary(TieredSystem* system);
+
+#endif
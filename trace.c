@@ -0,0 +1,295 @@
+//
+// trace.c
+//
+// Trace files describe a whole simulation without any console interaction. The first
+// non-comment line holds the storage size and the block size, and every following line is
+// one operation:
+//
+//     a <file name> <file size>    Add a file.
+//     d <file name>                Delete a file.
+//     p                            Print the directory and block table.
+//     s                            Print the utilization and fragmentation summary.
+//     r <storage size>             Grow or shrink the storage device to a new size.
+//
+// Blank lines and lines starting with '#' are ignored.
+//
+
+#include "trace.h"
+#include "directory.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#define TRACE_LINE_LENGTH 256
+
+
+/**
+ * Creates a new, empty Trace object for a system of the given size.
+ *
+ * @param systemSize Total size of the storage device the trace runs against.
+ * @param blockSize Size of each block on the storage device.
+ * @return A Trace object with no operations.
+ */
+Trace createTrace(long systemSize, long blockSize) {
+    Trace t;
+    t.systemSize = systemSize;
+    t.blockSize = blockSize;
+    t.count = 0;
+    t.capacity = 0;
+    t.ops = NULL;
+    t.names = NULL;
+    t.namesLength = 0;
+    t.namesCapacity = 0;
+    return t;
+}
+
+
+/**
+ * Frees the operation list and name pool of a Trace object.
+ *
+ * @param trace The Trace to be destroyed.
+ */
+void destroyTrace(Trace* trace) {
+    free(trace->ops);
+    free(trace->names);
+    trace->ops = NULL;
+    trace->names = NULL;
+    trace->count = 0;
+    trace->capacity = 0;
+    trace->namesLength = 0;
+    trace->namesCapacity = 0;
+}
+
+
+/**
+ * Appends an operation to the end of a Trace, growing the operation list and name pool as needed.
+ *
+ * @param trace The Trace being appended to.
+ * @param type One of the OP_ constants.
+ * @param fileName Name of the file the operation refers to, or NULL for operations without one.
+ * @param size Size of the file for OP_ADD operations, the new storage size for OP_RESIZE, ignored otherwise.
+ */
+void appendOperation(Trace* trace, char type, const char* fileName, long size) {
+    if (trace->count == trace->capacity) {
+        trace->capacity = trace->capacity == 0 ? 1024 : trace->capacity * 2;
+        trace->ops = realloc(trace->ops, sizeof(Operation) * trace->capacity);
+    }
+
+    Operation* op = trace->ops + trace->count;
+    op->type = type;
+    op->size = size;
+    op->nameOffset = -1;
+
+    if (fileName != NULL) {
+        long nameLength = (long) strlen(fileName) + 1;
+        if (trace->namesLength + nameLength > trace->namesCapacity) {
+            while (trace->namesLength + nameLength > trace->namesCapacity) {
+                trace->namesCapacity = trace->namesCapacity == 0 ? 16384 : trace->namesCapacity * 2;
+            }
+            trace->names = realloc(trace->names, trace->namesCapacity);
+        }
+        memcpy(trace->names + trace->namesLength, fileName, nameLength);
+        op->nameOffset = trace->namesLength;
+        trace->namesLength += nameLength;
+    }
+
+    trace->count++;
+}
+
+
+/**
+ * Looks up the file name of an operation within its Trace's name pool.
+ *
+ * @param trace The Trace the operation belongs to.
+ * @param op The operation whose file name is wanted.
+ * @return The file name, or NULL if the operation does not refer to a file.
+ */
+char* operationName(Trace* trace, Operation* op) {
+    if (op->nameOffset < 0) {
+        return NULL;
+    }
+    return trace->names + op->nameOffset;
+}
+
+
+/**
+ * Splits the next whitespace separated token off of a line, NUL terminating it in place.
+ *
+ * @param cursor Reference to the current position in the line, advanced past the token.
+ * @return The token, or NULL if the line has no more tokens.
+ */
+static char* nextToken(char** cursor) {
+    char* start = *cursor;
+    while (*start != '\0' && isspace((unsigned char) *start)) {
+        start++;
+    }
+    if (*start == '\0') {
+        *cursor = start;
+        return NULL;
+    }
+
+    char* end = start;
+    while (*end != '\0' && !isspace((unsigned char) *end)) {
+        end++;
+    }
+    if (*end != '\0') {
+        *end = '\0';
+        end++;
+    }
+    *cursor = end;
+    return start;
+}
+
+
+/**
+ * Parses a strictly positive decimal number that fits in a long.
+ *
+ * @param token The text to be parsed.
+ * @return The parsed value, or -1 if the token is not a valid positive number.
+ */
+static long parsePositive(const char* token) {
+    char* endPointer;
+    if (token == NULL) {
+        return -1;
+    }
+    errno = 0;
+    long value = strtol(token, &endPointer, 10);
+    if (*endPointer != '\0' || value <= 0 || errno == ERANGE) {
+        return -1;
+    }
+    return value;
+}
+
+
+/**
+ * Reads a trace file into a Trace object. The Trace passed in is overwritten, so it should not
+ * hold any operations yet. On failure an error is printed and the partially read Trace is destroyed.
+ *
+ * @param trace The Trace to be filled in.
+ * @param path Path of the trace file.
+ * @return 0 if the whole file was read successfully, -1 otherwise.
+ */
+int loadTrace(Trace* trace, const char* path) {
+    char line[TRACE_LINE_LENGTH];
+    long lineNumber = 0;
+    int haveHeader = 0;
+    int result = 0;
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Unable to open trace file: %s\n", path);
+        return -1;
+    }
+
+    *trace = createTrace(0, 0);
+    while (result == 0 && fgets(line, TRACE_LINE_LENGTH, file) != NULL) {
+        char* cursor = line;
+        char* command = nextToken(&cursor);
+        lineNumber++;
+
+        if (command == NULL || command[0] == '#') {  // Skip blank lines and comments.
+            continue;
+        }
+
+        if (!haveHeader) {  // The first line holds the system size and the block size.
+            trace->systemSize = parsePositive(command);
+            trace->blockSize = parsePositive(nextToken(&cursor));
+            if (trace->systemSize < 0 || trace->blockSize < 0 || trace->blockSize > trace->systemSize
+                || trace->systemSize % trace->blockSize != 0) {
+                printf("Trace line %ld: invalid storage or block size.\n", lineNumber);
+                result = -1;
+            }
+            haveHeader = 1;
+            continue;
+        }
+
+        char* fileName = nextToken(&cursor);
+        if (fileName != NULL && strlen(fileName) >= MAX_FILE_NAME) {
+            printf("Trace line %ld: file name too long.\n", lineNumber);
+            result = -1;
+        } else if (strcmp(command, "a") == 0 && fileName != NULL) {
+            long fileSize = parsePositive(nextToken(&cursor));
+            if (fileSize < 0) {
+                printf("Trace line %ld: invalid file size.\n", lineNumber);
+                result = -1;
+            } else {
+                appendOperation(trace, OP_ADD, fileName, fileSize);
+            }
+        } else if (strcmp(command, "d") == 0 && fileName != NULL) {
+            appendOperation(trace, OP_DELETE, fileName, 0);
+        } else if (strcmp(command, "p") == 0) {
+            appendOperation(trace, OP_PRINT, NULL, 0);
+        } else if (strcmp(command, "s") == 0) {
+            appendOperation(trace, OP_SUMMARY, NULL, 0);
+        } else if (strcmp(command, "r") == 0 && fileName != NULL) {  // Takes a size, not a name.
+            long systemSize = parsePositive(fileName);
+            if (systemSize < 0 || systemSize % trace->blockSize != 0) {
+                printf("Trace line %ld: invalid storage size.\n", lineNumber);
+                result = -1;
+            } else {
+                appendOperation(trace, OP_RESIZE, NULL, systemSize);
+            }
+        } else {
+            printf("Trace line %ld: unrecognized operation '%s'.\n", lineNumber, command);
+            result = -1;
+        }
+    }
+
+    if (result == 0 && !haveHeader) {
+        printf("Trace file is empty: %s\n", path);
+        result = -1;
+    }
+    fclose(file);
+
+    if (result != 0) {
+        destroyTrace(trace);
+    }
+    return result;
+}
+
+
+/**
+ * Writes a Trace to a file in the format read by loadTrace(), so it can be replayed later.
+ *
+ * @param trace The Trace to be written.
+ * @param path Path of the trace file, overwritten if it exists.
+ * @param comment Text written as a comment on the first line, or NULL for none.
+ * @return 0 if the whole trace was written, -1 otherwise.
+ */
+int writeTrace(Trace* trace, const char* path, const char* comment) {
+    long i;
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        printf("Unable to write trace file: %s\n", path);
+        return -1;
+    }
+
+    if (comment != NULL) {
+        fprintf(file, "# %s\n", comment);
+    }
+    fprintf(file, "%ld %ld\n", trace->systemSize, trace->blockSize);
+    for (i = 0; i < trace->count; i++) {
+        Operation* op = trace->ops + i;
+        switch (op->type) {
+            case OP_ADD:
+                fprintf(file, "a %s %ld\n", operationName(trace, op), op->size);
+                break;
+            case OP_DELETE:
+                fprintf(file, "d %s\n", operationName(trace, op));
+                break;
+            case OP_RESIZE:
+                fprintf(file, "r %ld\n", op->size);
+                break;
+            default:
+                fprintf(file, "%c\n", op->type);
+        }
+    }
+
+    int failed = ferror(file);
+    if (fclose(file) != 0 || failed) {
+        printf("Unable to write trace file: %s\n", path);
+        return -1;
+    }
+    return 0;
+}
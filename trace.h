@@ -0,0 +1,53 @@
+//
+// trace.h
+//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+typedef struct trace Trace;
+typedef struct operation Operation;
+
+/* Operation types that can appear in a trace file. */
+#define OP_ADD 'a'
+#define OP_DELETE 'd'
+#define OP_PRINT 'p'
+#define OP_SUMMARY 's'
+#define OP_RESIZE 'r'
+
+/**
+ * Definition of the Operation type. A single add, delete, print, summary or resize request read from
+ * a trace. File names are not stored inline; nameOffset indexes into the names pool of the owning
+ * Trace. size is the file size of an add, or the new storage size of a resize.
+ */
+struct operation {
+    char type;
+    long size;
+    long nameOffset;
+};
+
+/**
+ * Definition of the Trace type. Holds the system configuration and the full list of
+ * operations parsed from a trace file, with every file name packed into a single pool.
+ */
+struct trace {
+    long systemSize;
+    long blockSize;
+    long count;
+    long capacity;
+    Operation* ops;
+    char* names;
+    long namesLength;
+    long namesCapacity;
+};
+
+Trace createTrace(long systemSize, long blockSize);
+void destroyTrace(Trace* trace);
+int loadTrace(Trace* trace, const char* path);
+int writeTrace(Trace* trace, const char* path, const char* comment);
+void appendOperation(Trace* trace, char type, const char* fileName, long size);
+char* operationName(Trace* trace, Operation* op);
+
+#endif
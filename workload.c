@@ -0,0 +1,377 @@
+//
+// workload.c
+//
+// Workloads are described by a comma separated list of key=value settings, for example
+//
+//     ops=100000,dist=zipf,min=512,max=1048576,occupancy=95,lifetime=fifo,seed=7
+//
+// Settings that are left out keep the values from createWorkload(). The keys are:
+//
+//     ops          Number of operations to generate.
+//     system       Size of the storage device.
+//     block        Size of each block.
+//     dist         File size distribution: uniform, exponential, zipf or bimodal.
+//     min, max     Smallest and largest file size.
+//     mean         Mean file size above min for the exponential distribution.
+//     skew         Exponent of the Zipf distribution.
+//     large        Percent of files taken from the upper mode of the bimodal distribution.
+//     adds         Percent of operations that are adds while below the target occupancy.
+//     occupancy    Percent of the blocks the live files may take up before deletes are forced.
+//     lifetime     Which live file a delete removes: random, fifo (oldest) or lifo (newest).
+//     seed         Seed of the random number generator.
+//
+
+#include "workload.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+static const char* distributionNames[DIST_COUNT] = {"uniform", "exponential", "zipf", "bimodal"};
+static const char* lifetimeNames[LIFETIME_COUNT] = {"random", "fifo", "lifo"};
+
+
+/**
+ * Creates a Workload with the default settings: 100000 operations against a 100 MiB device
+ * with 4 KiB blocks, uniform file sizes up to 64 KiB, 60% adds and 90% target occupancy.
+ *
+ * @return A Workload with every setting filled in.
+ */
+Workload createWorkload(void) {
+    Workload w;
+    w.operations = 100000;
+    w.systemSize = 100L * 1024 * 1024;
+    w.blockSize = 4096;
+    w.distribution = DIST_UNIFORM;
+    w.minSize = 1;
+    w.maxSize = 64 * 1024;
+    w.mean = 0;  // Chosen from the size range when the workload is generated.
+    w.skew = 1.0;
+    w.largePercent = 10;
+    w.addPercent = 60;
+    w.occupancyPercent = 90;
+    w.lifetime = LIFETIME_RANDOM;
+    w.seed = 1;
+    return w;
+}
+
+
+/**
+ * Advances a splitmix64 generator.
+ *
+ * @param state The generator state, updated in place.
+ * @return The next 64 random bits.
+ */
+uint64_t nextRandom(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+
+/**
+ * Draws a uniformly distributed number from a splitmix64 generator.
+ *
+ * @param state The generator state, updated in place.
+ * @return A number in [0, 1).
+ */
+double randomUnit(uint64_t* state) {
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/**
+ * Draws a uniformly distributed integer in [low, high].
+ */
+static long randomBetween(uint64_t* state, long low, long high) {
+    return low + (long) (nextRandom(state) % (uint64_t) (high - low + 1));
+}
+
+
+/**
+ * Finds a name in a list of names.
+ *
+ * @return The index of the name, or -1 if it is not in the list.
+ */
+static int findName(const char** names, int count, const char* name) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * Parses a whole decimal number that is at least the given minimum and fits in a long.
+ *
+ * @return 0 if the text was a valid number, -1 otherwise.
+ */
+static int parseLong(const char* text, long minimum, long* value) {
+    char* endPointer;
+    errno = 0;
+    long parsed = strtol(text, &endPointer, 10);
+    if (*text == '\0' || *endPointer != '\0' || parsed < minimum || errno == ERANGE) {
+        return -1;
+    }
+    *value = parsed;
+    return 0;
+}
+
+
+/**
+ * Parses a whole decimal percentage between the given minimum and 100.
+ *
+ * @return 0 if the text was a valid percentage, -1 otherwise.
+ */
+static int parsePercent(const char* text, long minimum, int* value) {
+    long parsed;
+    if (parseLong(text, minimum, &parsed) != 0 || parsed > 100) {
+        return -1;
+    }
+    *value = (int) parsed;
+    return 0;
+}
+
+
+/**
+ * Parses a strictly positive real number.
+ *
+ * @return 0 if the text was a valid number, -1 otherwise.
+ */
+static int parsePositiveReal(const char* text, double* value) {
+    char* endPointer;
+    double parsed = strtod(text, &endPointer);
+    if (*text == '\0' || *endPointer != '\0' || !(parsed > 0)) {
+        return -1;
+    }
+    *value = parsed;
+    return 0;
+}
+
+
+/**
+ * Applies a single key=value setting to a Workload.
+ *
+ * @return 0 if the setting was applied, -1 if the key is unknown or the value is invalid.
+ */
+static int applySetting(Workload* w, const char* key, const char* value) {
+    long number;
+    if (strcmp(key, "ops") == 0) {
+        return parseLong(value, 1, &w->operations);
+    } else if (strcmp(key, "system") == 0) {
+        return parseLong(value, 1, &w->systemSize);
+    } else if (strcmp(key, "block") == 0) {
+        return parseLong(value, 1, &w->blockSize);
+    } else if (strcmp(key, "dist") == 0) {
+        w->distribution = findName(distributionNames, DIST_COUNT, value);
+        return w->distribution < 0 ? -1 : 0;
+    } else if (strcmp(key, "min") == 0) {
+        return parseLong(value, 1, &w->minSize);
+    } else if (strcmp(key, "max") == 0) {
+        return parseLong(value, 1, &w->maxSize);
+    } else if (strcmp(key, "mean") == 0) {
+        return parsePositiveReal(value, &w->mean);
+    } else if (strcmp(key, "skew") == 0) {
+        return parsePositiveReal(value, &w->skew);
+    } else if (strcmp(key, "large") == 0) {
+        return parsePercent(value, 0, &w->largePercent);
+    } else if (strcmp(key, "adds") == 0) {
+        return parsePercent(value, 0, &w->addPercent);
+    } else if (strcmp(key, "occupancy") == 0) {
+        return parsePercent(value, 1, &w->occupancyPercent);
+    } else if (strcmp(key, "lifetime") == 0) {
+        w->lifetime = findName(lifetimeNames, LIFETIME_COUNT, value);
+        return w->lifetime < 0 ? -1 : 0;
+    } else if (strcmp(key, "seed") == 0) {
+        if (parseLong(value, 0, &number) != 0) {
+            return -1;
+        }
+        w->seed = (uint64_t) number;
+        return 0;
+    }
+    return -1;
+}
+
+
+/**
+ * Applies a comma separated list of key=value settings to a Workload. Settings that are not
+ * in the list keep their current values. An error is printed for the first invalid setting.
+ *
+ * @param workload The Workload being configured.
+ * @param spec The list of settings.
+ * @return 0 if every setting was applied and the result is consistent, -1 otherwise.
+ */
+int parseWorkload(Workload* workload, const char* spec) {
+    char* copy = malloc(strlen(spec) + 1);
+    char* setting;
+    int result = 0;
+    strcpy(copy, spec);
+
+    for (setting = strtok(copy, ","); setting != NULL && result == 0; setting = strtok(NULL, ",")) {
+        char* value = strchr(setting, '=');
+        if (value == NULL) {
+            printf("Workload setting is not of the form key=value: %s\n", setting);
+            result = -1;
+            continue;
+        }
+        *value = '\0';
+        value++;
+        if (applySetting(workload, setting, value) != 0) {
+            printf("Invalid workload setting: %s=%s\n", setting, value);
+            result = -1;
+        }
+    }
+    free(copy);
+
+    if (result == 0 && (workload->blockSize > workload->systemSize
+                        || workload->systemSize % workload->blockSize != 0)) {
+        printf("Workload system size must be a multiple of the block size.\n");
+        result = -1;
+    } else if (result == 0 && workload->minSize > workload->maxSize) {
+        printf("Workload minimum file size is larger than the maximum.\n");
+        result = -1;
+    }
+    return result;
+}
+
+
+/**
+ * Draws a file size from the distribution of a Workload.
+ */
+static long drawSize(Workload* w, uint64_t* state) {
+    long range = w->maxSize - w->minSize + 1;
+    long size;
+    double u = randomUnit(state);
+
+    switch (w->distribution) {
+        case DIST_EXPONENTIAL: {  // Inverse CDF of the exponential truncated to the size range.
+            double mean = w->mean > 0 ? w->mean : range / 8.0 + 1;
+            size = w->minSize + (long) (-mean * log(1 - u * (1 - exp(-range / mean))));
+            break;
+        }
+        case DIST_ZIPF: {  // Continuous inverse CDF of the power law, rank 1 is the smallest size.
+            double ranks = (double) range + 1;
+            double rank;
+            if (fabs(w->skew - 1) < 1e-9) {
+                rank = exp(u * log(ranks));
+            } else {
+                rank = pow((pow(ranks, 1 - w->skew) - 1) * u + 1, 1 / (1 - w->skew));
+            }
+            size = w->minSize + (long) rank - 1;
+            break;
+        }
+        case DIST_BIMODAL: {  // Files come from either the lowest or the highest eighth of the range.
+            long mode = (range - 1) / 8;
+            if (u * 100 < w->largePercent) {
+                size = randomBetween(state, w->maxSize - mode, w->maxSize);
+            } else {
+                size = randomBetween(state, w->minSize, w->minSize + mode);
+            }
+            break;
+        }
+        default:
+            size = w->minSize + (long) (u * range);
+    }
+
+    if (size < w->minSize) {  // Guards against rounding at the ends of the range.
+        size = w->minSize;
+    } else if (size > w->maxSize) {
+        size = w->maxSize;
+    }
+    return size;
+}
+
+
+/**
+ * Generates the operations described by a Workload into a new Trace. Files are named after
+ * the order they were added in, so names are never reused and no add is a duplicate. The
+ * Workload keeps its own count of the blocks its files need, which is the occupancy the
+ * target is checked against; adds that the allocator turns down do not lower it.
+ *
+ * @param workload The Workload to be generated.
+ * @param trace Overwritten with the generated operations.
+ * @return 0 once the Trace has been generated.
+ */
+int generateWorkload(Workload* workload, Trace* trace) {
+    uint64_t state = workload->seed;
+    long totalBlocks = workload->systemSize / workload->blockSize;
+    long blockLimit = totalBlocks / 100 * workload->occupancyPercent
+                      + totalBlocks % 100 * workload->occupancyPercent / 100;
+    long* live = malloc(sizeof(long) * workload->operations);
+    long* blocks = malloc(sizeof(long) * workload->operations);
+    long head = 0, tail = 0, liveBlocks = 0, added = 0;
+    long i;
+    char fileName[32];
+
+    *trace = createTrace(workload->systemSize, workload->blockSize);
+    for (i = 0; i < workload->operations; i++) {
+        long size = drawSize(workload, &state);
+        long needed = (size - 1) / workload->blockSize + 1;
+        int isAdd = randomUnit(&state) * 100 < workload->addPercent;
+
+        if (head < tail && liveBlocks + needed > blockLimit) {  // Above the target, make room first.
+            isAdd = 0;
+        } else if (head == tail) {  // Nothing to delete.
+            isAdd = 1;
+        }
+
+        long id;
+        if (isAdd) {
+            id = added++;
+            blocks[id] = needed;
+            live[tail++] = id;
+            liveBlocks += needed;
+            snprintf(fileName, sizeof(fileName), "w%ld", id);
+            appendOperation(trace, OP_ADD, fileName, size);
+            continue;
+        }
+
+        switch (workload->lifetime) {
+            case LIFETIME_FIFO:
+                id = live[head++];
+                break;
+            case LIFETIME_LIFO:
+                id = live[--tail];
+                break;
+            default: {
+                long pick = randomBetween(&state, head, tail - 1);
+                id = live[pick];
+                live[pick] = live[--tail];
+            }
+        }
+        liveBlocks -= blocks[id];
+        snprintf(fileName, sizeof(fileName), "w%ld", id);
+        appendOperation(trace, OP_DELETE, fileName, 0);
+    }
+
+    free(live);
+    free(blocks);
+    return 0;
+}
+
+
+/**
+ * Writes the settings of a Workload as a spec that parseWorkload() accepts.
+ *
+ * @param workload The Workload to be described.
+ * @param buffer Receives the spec.
+ * @param length Size of the buffer.
+ */
+void formatWorkload(Workload* workload, char* buffer, long length) {
+    int written = snprintf(buffer, length,
+                           "ops=%ld,system=%ld,block=%ld,dist=%s,min=%ld,max=%ld,skew=%g,large=%d,"
+                           "adds=%d,occupancy=%d,lifetime=%s,seed=%llu",
+                           workload->operations, workload->systemSize, workload->blockSize,
+                           distributionNames[workload->distribution], workload->minSize,
+                           workload->maxSize, workload->skew, workload->largePercent,
+                           workload->addPercent, workload->occupancyPercent,
+                           lifetimeNames[workload->lifetime], (unsigned long long) workload->seed);
+    if (workload->mean > 0 && written >= 0 && written < length) {  // Left out while it is the default.
+        snprintf(buffer + written, length - written, ",mean=%g", workload->mean);
+    }
+}
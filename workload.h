@@ -0,0 +1,59 @@
+//
+// workload.h
+//
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdint.h>
+#include "trace.h"
+
+typedef struct workload Workload;
+
+/* File size distributions a Workload can draw from. */
+#define DIST_UNIFORM 0
+#define DIST_EXPONENTIAL 1
+#define DIST_ZIPF 2
+#define DIST_BIMODAL 3
+#define DIST_COUNT 4
+
+/* Orders in which a Workload deletes the files it has added. */
+#define LIFETIME_RANDOM 0
+#define LIFETIME_FIFO 1
+#define LIFETIME_LIFO 2
+#define LIFETIME_COUNT 3
+
+/**
+ * Definition of the Workload type. Describes a synthetic stream of add and delete operations.
+ * File sizes fall in [minSize, maxSize] and follow the chosen distribution: mean is the mean of
+ * the exponential distribution, skew the exponent of the Zipf distribution, and largePercent the
+ * share of files drawn from the upper mode of the bimodal distribution. Each operation is an add
+ * with probability addPercent, except that deletes are forced once the added files would take up
+ * more than occupancyPercent of the blocks. lifetime picks which live file a delete removes.
+ * Every random choice comes from a PRNG started at seed, so a Workload always produces the same
+ * operations.
+ */
+struct workload {
+    long operations;
+    long systemSize;
+    long blockSize;
+    int distribution;
+    long minSize;
+    long maxSize;
+    double mean;
+    double skew;
+    int largePercent;
+    int addPercent;
+    int occupancyPercent;
+    int lifetime;
+    uint64_t seed;
+};
+
+Workload createWorkload(void);
+int parseWorkload(Workload* workload, const char* spec);
+int generateWorkload(Workload* workload, Trace* trace);
+void formatWorkload(Workload* workload, char* buffer, long length);
+uint64_t nextRandom(uint64_t* state);
+double randomUnit(uint64_t* state);
+
+#endif